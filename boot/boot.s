@@ -83,7 +83,13 @@ _start:
 	aligned above and we've pushed a multiple of 16 bytes to the
 	stack since (pushed 0 bytes so far), so the alignment has thus been
 	preserved and the call is well defined.
+
+	The bootloader leaves the physical address of the multiboot info
+	structure in %ebx; pass it as kernel_main's only argument, padding the
+	stack so it is still 16-byte aligned at the call.
 	*/
+	subl $12, %esp
+	pushl %ebx
 	call kernel_main
 
 	/*
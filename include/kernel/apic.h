@@ -0,0 +1,52 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+// Local APIC + I/O APIC interrupt routing. apic_init finds the controllers through the
+// ACPI MADT (or the older MP table), masks the 8259 and routes the ISA IRQs through the
+// I/O APIC to vectors 32-47, the same vectors the remapped 8259 used. An EOI is then one
+// store to a local APIC register instead of one or two port writes; apic_init installs
+// it with irq_set_eoi. Without an APIC the 8259 keeps routing interrupts.
+
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+#define IOAPIC_MAX 4
+
+// Redirection flags, in the MPS INTI encoding that both the MADT and the MP table use.
+#define APIC_POLARITY_MASK   0x3
+#define APIC_POLARITY_LOW    0x3
+#define APIC_TRIGGER_MASK    0xC
+#define APIC_TRIGGER_LEVEL   0xC
+
+typedef struct ioapic {
+    uint32_t phys;
+    volatile uint32_t* regs;
+    uint32_t gsi_base;       // First global system interrupt it handles
+    uint32_t count;          // Redirection entries
+    uint8_t id;
+} ioapic_t;
+
+// Detect and enable the APICs. Needs paging for the register mappings. Returns 1 if the
+// APIC now routes IRQs, 0 if the 8259 is still in charge.
+int apic_init();
+
+// True once apic_init has switched interrupt routing over to the APIC.
+bool apic_enabled();
+
+// Program the redirection entry for global system interrupt 'gsi': deliver 'vector' to
+// the boot CPU, with 'flags' polarity/trigger. Returns 0 if no I/O APIC handles 'gsi'.
+int ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, bool masked);
+void ioapic_set_mask(uint32_t gsi, bool masked);
+
+// Global system interrupt an ISA IRQ is wired to (after interrupt source overrides).
+uint32_t apic_isa_gsi(uint8_t irq);
+
+// Mask/unmask an ISA IRQ at the I/O APIC, like pic_unmask_irq does at the 8259.
+void apic_mask_irq(uint8_t irq);
+void apic_unmask_irq(uint8_t irq);
+
+// Detected I/O APICs; returns their count.
+uint32_t ioapic_list(const ioapic_t** list);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef KERNEL_BITMAP_H
+#define KERNEL_BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bitmap with summary levels for fast lowest-clear-bit searches. Level 0 holds the bits;
+// a bit at level n + 1 is set when the corresponding 32-bit word at level n is full.
+// The top level is a single word, so a search touches at most one word per level on
+// the way up and one on the way down.
+class SummaryBitmap {
+public:
+    static const int MAX_LEVELS = 5;  // Enough for 32^5 bits
+
+    // Words of storage needed for 'bits' bits, summary levels included.
+    static uint32_t words_needed(uint32_t bits);
+
+    // Lay the bitmap out in 'storage'. All bits start out clear, or set if 'set_all'.
+    void init(uint32_t* storage, uint32_t bits, bool set_all);
+
+    void set(uint32_t idx);
+    void clear(uint32_t idx);
+    void set_range(uint32_t start, uint32_t count);
+    void clear_range(uint32_t start, uint32_t count);
+    bool test(uint32_t idx) const {
+        return (levels[0][idx / 32] >> (idx % 32)) & 1;
+    }
+
+    // Lowest clear bit, or UINT32_MAX if every bit is set.
+    uint32_t find_clear();
+
+    // Lowest clear bit at or after 'start', or UINT32_MAX.
+    uint32_t find_clear_from(uint32_t start) const;
+
+    uint32_t size() const { return bits; }
+    const uint32_t* words() const { return levels[0]; }
+
+private:
+    void set_at(int level, uint32_t idx);
+    void clear_at(int level, uint32_t idx);
+
+    uint32_t* levels[MAX_LEVELS];
+    uint32_t level_words[MAX_LEVELS];
+    int level_count;
+    uint32_t bits;
+    uint32_t hint;  // No bit below this index is clear
+};
+
+#endif // KERNEL_BITMAP_H
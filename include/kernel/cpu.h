@@ -0,0 +1,72 @@
+#ifndef KERNEL_CPU_H
+#define KERNEL_CPU_H
+
+#include <stdint.h>
+
+// Time-stamp counter, for cycle measurements in benchmarks.
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_EDX_PSE  (1u << 3)   // 4 MiB pages
+#define CPUID_FEAT_EDX_MSR  (1u << 5)   // rdmsr/wrmsr
+#define CPUID_FEAT_EDX_PAE  (1u << 6)   // Physical address extension
+#define CPUID_FEAT_EDX_APIC (1u << 9)   // On-chip local APIC
+#define CPUID_FEAT_EDX_PGE  (1u << 13)  // Global pages
+
+#define CR4_PSE  (1u << 4)
+#define CR4_PAE  (1u << 5)
+#define CR4_PGE  (1u << 7)
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+// True if CPUID leaf 1 reports every bit in 'mask' in EDX.
+static inline bool cpu_has_edx_features(uint32_t mask) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & mask) == mask;
+}
+
+static inline uint32_t read_cr4() {
+    uint32_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    asm volatile("mov %0, %%cr4" :: "r"(value) : "memory");
+}
+
+#define MSR_APIC_BASE          0x1B
+#define MSR_APIC_BASE_ENABLE   (1u << 11)
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Disable interrupts and return the previous EFLAGS, for short critical sections.
+static inline uint32_t irq_save() {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+// Re-enable interrupts if they were enabled when irq_save was called.
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+#endif // KERNEL_CPU_H
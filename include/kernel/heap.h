@@ -4,12 +4,64 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define KERNEL_HEAP_START  0x00800000  // 8 MiB
-#define KERNEL_HEAP_SIZE   0x00800000  // 8 MiB heap (adjustable)
+// The heap lives in its own virtual window and is backed on demand by frames from
+// PhysicalMemoryManager, so it can grow into whatever RAM the machine has.
+#define KERNEL_HEAP_START         0xD0000000
+#define KERNEL_HEAP_MAX_SIZE      0x10000000  // 256 MiB virtual window
+#define KERNEL_HEAP_INITIAL_SIZE  0x00100000  // 1 MiB mapped at boot
+#define KERNEL_HEAP_GROW_MIN      0x00010000  // Grow by at least 64 KiB at a time
+#define KERNEL_HEAP_TRIM_MIN      0x00040000  // Release a free tail once it reaches 256 KiB
+
+// Requests of KERNEL_HEAP_PAGE_THRESHOLD bytes or more bypass the block allocator and get
+// whole pages of their own in a separate window, so they never split the general free lists.
+#define KERNEL_PAGE_AREA_START      0xE0000000
+#define KERNEL_PAGE_AREA_SIZE       0x10000000  // 256 MiB virtual window
+#define KERNEL_HEAP_PAGE_THRESHOLD  0x00008000  // 32 KiB
+
+// Block allocator behind kmalloc: 1 = TLSF (bounded O(1)), 0 = legacy first-fit list.
+// Override with `make HEAP_USE_TLSF=0`.
+#ifndef HEAP_USE_TLSF
+#define HEAP_USE_TLSF 1
+#endif
+
+// Request-size histogram buckets: <=16, <=32, ..., <=64 KiB, larger.
+#define HEAP_HIST_BUCKETS 14
+
+typedef struct heap_stats {
+    size_t heap_size;            // Bytes currently mapped for the heap
+    size_t bytes_in_use;         // Usable bytes of all live allocations
+    size_t peak_in_use;          // High-water mark of bytes_in_use
+    size_t free_bytes;           // Free bytes in the block allocator
+    size_t largest_free;         // Largest free block
+    uint32_t free_blocks;
+    uint32_t used_blocks;        // Block allocator blocks, including slab pages
+    uint32_t slab_pages;
+    uint32_t area_pages;         // Pages held by page-granular allocations, reserved ones included
+    uint32_t fragmentation_pct;  // 100 - largest_free * 100 / free_bytes
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t failed_allocs;
+    uint32_t size_histogram[HEAP_HIST_BUCKETS];
+} heap_stats_t;
 
 void init_heap();
 void* kmalloc(size_t size);
 void kfree(void* ptr);
 void* krealloc(void* ptr, size_t size);
 
+// Allocate 'size' bytes aligned to 'align' (a power of two). Free with kfree.
+void* kmalloc_aligned(size_t size, size_t align);
+
+// Allocate 'count' whole, page-aligned pages. Free with kfree.
+void* kmalloc_pages(size_t count);
+
+// Reserve 'count' page-aligned pages without backing them: each page gets a zeroed frame
+// from the page fault handler when it is first touched. Only address space can run out
+// here; running out of memory on first touch is fatal, so this suits large sparse
+// buffers, not memory the caller must be sure to get. Free with kfree.
+void* kreserve_pages(size_t count);
+
+// Snapshot the heap counters. Walks the block list for the free-space figures.
+void heap_get_stats(heap_stats_t* stats);
+
 #endif
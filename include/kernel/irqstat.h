@@ -0,0 +1,49 @@
+#ifndef IRQSTAT_H
+#define IRQSTAT_H
+
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+// Per-vector interrupt statistics: how often each vector fired and how long its pass
+// through isr_handler/irq_timed_call took, in TSC cycles. Durations go into log2 buckets,
+// so the cost per interrupt is two rdtsc and a handful of adds. Build with
+// `make IRQ_STATS=0` to compile the recording out entirely.
+#ifndef IRQ_STATS
+#define IRQ_STATS 1
+#endif
+
+#define IRQSTAT_VECTORS  48   // CPU exceptions and the 16 ISA IRQs
+#define IRQSTAT_BUCKETS  32   // Bucket b counts durations in [2^b, 2^(b+1)) cycles
+
+typedef struct irqstat {
+    uint32_t count;
+    uint32_t cycles_max;
+    uint64_t cycles_total;
+    uint32_t hist[IRQSTAT_BUCKETS];
+} irqstat_t;
+
+#if IRQ_STATS
+static inline uint64_t irqstat_begin() {
+    return rdtsc();
+}
+
+// Account one pass through the handler for 'vector' that started at 'start'.
+void irqstat_record(uint32_t vector, uint64_t start);
+#else
+static inline uint64_t irqstat_begin() {
+    return 0;
+}
+
+static inline void irqstat_record(uint32_t, uint64_t) {}
+#endif
+
+// Consistent copy of the statistics for 'vector'. Returns false if the vector is not
+// tracked or IRQ_STATS is 0.
+bool irqstat_snapshot(uint32_t vector, irqstat_t* out);
+
+// Mean cycles per interrupt, without 64-bit division.
+uint32_t irqstat_average(const irqstat_t* stat);
+
+void irqstat_reset();
+
+#endif
@@ -14,4 +14,12 @@ typedef struct registers {
 typedef void (*isr_t)(registers_t*);
 void register_interrupt_handler(uint8_t n, isr_t handler);
 
+// Acknowledge ISA IRQ vector 'vector' at the interrupt controller. irq_common_stub calls
+// the current one after every ISA IRQ; the 8259 until apic_init switches it over.
+typedef void (*irq_eoi_t)(uint32_t vector);
+void irq_set_eoi(irq_eoi_t eoi);
+
+// Unmask ISA IRQ 'irq' (vector 32 + irq) at the 8259 or the I/O APIC, whichever routes it.
+void irq_unmask(uint8_t irq);
+
 #endif
\ No newline at end of file
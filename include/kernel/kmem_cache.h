@@ -0,0 +1,43 @@
+#ifndef KMEM_CACHE_H
+#define KMEM_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Typed object caches: every cache hands out objects of one fixed size from its own
+// 4 KiB slabs, so frequently created objects skip the general heap entirely and
+// objects of the same type stay packed together.
+
+#define KMEM_CACHE_LINE   64
+
+// Flags for kmem_cache_create
+#define KMEM_CACHE_ALIGN  0x1  // Align every object to KMEM_CACHE_LINE
+
+typedef void (*kmem_ctor_t)(void* obj);
+
+typedef struct kmem_slab kmem_slab_t;
+
+typedef struct kmem_cache {
+    const char* name;
+    size_t obj_size;             // Object stride, including alignment padding
+    size_t first_offset;         // Offset of the first object in a slab
+    uint16_t per_slab;           // Objects per slab
+    kmem_ctor_t ctor;            // Run on every object as it is handed out, may be NULL
+    kmem_slab_t* partial;        // Slabs with at least one free object
+    kmem_slab_t* empty;          // One cached empty slab
+    uint32_t slab_count;
+    uint32_t objs_in_use;
+    struct kmem_cache* next;     // All caches, for kmem_cache_list
+} kmem_cache_t;
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, uint32_t flags, kmem_ctor_t ctor);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+// Give the cached empty slab back to the heap.
+void kmem_cache_shrink(kmem_cache_t* cache);
+
+// First cache in the list of all caches (follow ->next).
+kmem_cache_t* kmem_cache_list();
+
+#endif
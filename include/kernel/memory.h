@@ -3,31 +3,146 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "kernel/bitmap.h"
+#include "kernel/paging.h"  // PAGE_SIZE, VMM_USE_PAE
 
-#define PAGE_SIZE 4096
+// Physical memory the PMM manages stops here. 32-bit paging cannot map anything above
+// 4 GiB; PAE could reach 64 GiB, but past 16 GiB the frame bitmaps and share counts
+// would no longer fit in the identity map.
+#if VMM_USE_PAE
+#define PMM_PHYS_LIMIT 0x400000000ULL
+#else
+#define PMM_PHYS_LIMIT 0x100000000ULL
+#endif
+
+// Largest buddy order: blocks of 2^10 frames (4 MiB).
+#define PMM_MAX_ORDER 10
+
+// A frame shared this many extra times is pinned for good rather than overflowing.
+#define PMM_MAX_SHARES 255
+
+// Frames kept zeroed ahead of time for allocate_zeroed_pfn.
+#define PMM_ZERO_POOL_SIZE 32
+
+// Physical memory zones. Zone boundaries are multiples of the largest buddy block, so
+// a block never straddles two zones.
+enum pmm_zone {
+    ZONE_DMA,     // Below 16 MiB: ISA DMA, and identity-mapped for the kernel
+    ZONE_NORMAL,  // 16 MiB .. 4 GiB: 32-bit DMA
+    ZONE_HIGH,    // Above 4 GiB
+    ZONE_COUNT
+};
+
+// Frames a lower zone keeps back from allocations that fell back from a higher zone.
+#define PMM_ZONE_RESERVE 256
+
+typedef struct pmm_zone_stats {
+    uint32_t managed_frames;   // Frames handed to the allocator at boot
+    uint32_t free_frames;
+    uint32_t fallback_allocs;  // Blocks given out to requests that preferred a higher zone
+} pmm_zone_stats_t;
 
 class PhysicalMemoryManager {
 public:
     static void initialize(uint32_t multiboot_info_addr);
 
-    static void* allocate_frame();
+    // Allocation calls take the highest zone the caller can use. Memory comes from that
+    // zone first and falls back to lower zones, so bulk users leave low memory for the
+    // devices that need it. Pass ZONE_DMA for frames that must be identity-mapped.
+
+    // The calls below that deal in pointers only ever return frames under 4 GiB (at
+    // most ZONE_NORMAL). Frames in ZONE_HIGH are only reachable by frame number.
+
+    // Single frames; thin wrappers over the order-0 buddy calls.
+    static void* allocate_frame(pmm_zone zone = ZONE_HIGH);
     static void free_frame(void* frame);
 
-    static size_t get_memory_size();
+    // Physically contiguous, naturally aligned blocks of 2^order frames.
+    static void* allocate_frames(uint32_t order, pmm_zone zone = ZONE_HIGH);
+    static void free_frames(void* addr, uint32_t order);
+
+    // Fill out[0..count) with frames, taking whole buddy blocks at a time so the frames
+    // come in contiguous runs. Returns how many frames were allocated, which is less
+    // than 'count' only when memory runs out.
+    static uint32_t allocate_frames_bulk(uint32_t count, void** out, pmm_zone zone = ZONE_HIGH);
+
+    // Release 'count' frames from 'frames', in any order. Consecutive runs are freed as
+    // whole blocks.
+    static void free_frames_bulk(uint32_t count, void* const* frames);
+
+    // The same by frame number, so the frames may come from above 4 GiB with PAE.
+    static uint32_t allocate_pfns_bulk(uint32_t count, uint32_t* out, pmm_zone zone = ZONE_HIGH);
+    static void free_pfns_bulk(uint32_t count, const uint32_t* pfns);
+
+    // Single frames by frame number, from any zone up to 'zone'. allocate_pfn returns 0
+    // when out of memory (frame 0 is never handed out).
+    static uint32_t allocate_pfn(pmm_zone zone = ZONE_HIGH);
+    static void free_pfn(uint32_t pfn);
+
+    // Copy-on-write sharing of single frames: share_pfn adds a reference to an
+    // allocated frame, and free_pfn / free_frame drop one, releasing the frame with the
+    // last. pfn_refs is 0 for a free frame and 1 for one with a single owner.
+    static void share_pfn(uint32_t pfn);
+    static uint32_t pfn_refs(uint32_t pfn);
+
+    // A frame filled with zeroes, by frame number and from any zone, taken from the
+    // pre-zeroed pool when possible; 0 if memory is out. Page tables come from here.
+    // Free it with free_pfn.
+    static uint32_t allocate_zeroed_pfn();
+
+    // A zeroed ZONE_DMA frame, for the few users that reach it through the identity map.
+    // Zeroed on the spot, never from the pool. Free it with free_frame.
+    static void* allocate_zeroed_frame();
+
+    // Zero up to 'budget' frames into the pool, taken from the highest zone. Called from
+    // the idle loop; each frame is zeroed with interrupts disabled only for that frame.
+    // Returns false once the pool is full.
+    static bool refill_zero_pool(uint32_t budget);
+
+    static uint32_t zero_pool_level();
+    static uint32_t zero_pool_hits;
+    static uint32_t zero_pool_misses;
+
+    static void get_zone_stats(pmm_zone zone, pmm_zone_stats_t* out);
+    static const char* zone_name(pmm_zone zone);
+
+    static uint64_t get_memory_size();
+    static uint32_t get_total_frames();
     static size_t get_free_frames();
 
-    static void set_frame(uint32_t frame_addr);
-    static void clear_frame(uint32_t frame_addr);
     static uint32_t test_frame(uint32_t frame_addr);
     static uint32_t first_free();
     static uint32_t used_frames;
 
+    // The original linear scan from frame 0, kept as the baseline for pmm_benchmark.
+    static uint32_t first_free_linear();
 
 private:
-    static uint32_t* bitmap;
+    static uint32_t take_block(uint32_t order, pmm_zone zone);
+    static uint32_t take_block_in(uint32_t order, int zone);
+    static pmm_zone populated_zone(pmm_zone zone);
+    static bool can_fall_back(int zone, uint32_t order);
+    static void put_block(uint32_t frame, uint32_t order);
+    static void set_frame(uint32_t frame_addr);
+    static void clear_frame(uint32_t frame_addr);
+
+    // Hand the frames in [start, end) to the buddy allocator as maximal aligned blocks.
+    static void release_range(uint32_t start, uint32_t end);
+
+    // Frame bitmap, bit set = used.
+    static SummaryBitmap frames;
+
+    // Buddy free areas: bit clear = block of that order is free.
+    static SummaryBitmap free_area[PMM_MAX_ORDER + 1];
+
     static uint32_t total_frames;
 
+    // References beyond the first, one byte per frame.
+    static uint8_t* share_counts;
 
+    static pmm_zone_stats_t zones[ZONE_COUNT];
 
+    static uint32_t zero_pool[];
+    static uint32_t zero_pool_count;
 };
 #endif
@@ -3,24 +3,186 @@
 
 #include <stdint.h>
 
-// For the PDE/PTE arrays
+// Build PAE page tables (three levels, 64-bit entries) instead of classic 32-bit ones, so
+// physical memory above 4 GiB can be mapped. Enable with `make VMM_USE_PAE=1`; the CPU
+// must support PAE.
+#ifndef VMM_USE_PAE
+#define VMM_USE_PAE 0
+#endif
+
 #define PAGE_SIZE    4096
-#define PDE_ENTRIES  1024
-#define PTE_ENTRIES  1024
+
+#if VMM_USE_PAE
+// A 4-entry page-directory-pointer table selects one of four 512-entry directories;
+// each PDE maps a 512-entry page table or a 2 MiB page.
+typedef uint64_t vmm_entry_t;
+typedef uint64_t phys_addr_t;
+#define PDE_ENTRIES      512
+#define PTE_ENTRIES      512
+#define VMM_DIR_PAGES    4           // Page-directory pages per address space
+#define PDE_SHIFT        21
+#define LARGE_PAGE_SIZE  0x200000
+#define PTE_ADDR_MASK    0x000FFFFFFFFFF000ULL
+#else
+typedef uint32_t vmm_entry_t;
+typedef uint32_t phys_addr_t;
+#define PDE_ENTRIES      1024
+#define PTE_ENTRIES      1024
+#define VMM_DIR_PAGES    1
+#define PDE_SHIFT        22
+#define LARGE_PAGE_SIZE  0x400000
+#define PTE_ADDR_MASK    0xFFFFF000
+#endif
+
+// Directory slots covering the 4 GiB address space, across all directory pages.
+#define VMM_DIR_SLOTS    (PDE_ENTRIES * VMM_DIR_PAGES)
+
+// Page directory / page table entry flags
+#define PTE_PRESENT  0x001
+#define PTE_RW       0x002
+#define PTE_PWT      0x008  // Write-through
+#define PTE_PCD      0x010  // Cache disabled
+#define PDE_LARGE    0x080  // LARGE_PAGE_SIZE page (needs CR4.PSE without PAE)
+#define PTE_GLOBAL   0x100  // Kept in the TLB across CR3 loads (needs CR4.PGE)
+#define PTE_COW      0x200  // Software bit: read-only because the frame is shared copy-on-write
+
+// Kernel mappings (the identity range and everything from here up) are global, so their
+// TLB entries survive address-space switches.
+#define VMM_KERNEL_BASE  0xC0000000
+
+// Map the identity range with large pages when the CPU supports them. Override with
+// `make VMM_USE_PSE=0` to keep 4 KiB page tables everywhere.
+#ifndef VMM_USE_PSE
+#define VMM_USE_PSE 1
+#endif
+
+// Physical memory below this is identity-mapped and can be accessed directly.
+#define VMM_IDENTITY_LIMIT  0x01000000
+
+// Each address space has its own page tables for this range; every other directory slot
+// is shared by all of them. Cloning an address space copies this range copy-on-write.
+#define VMM_PRIVATE_START   VMM_IDENTITY_LIMIT
+#define VMM_PRIVATE_END     VMM_KERNEL_BASE
+
+// Scratch virtual page used to reach frames outside the identity map.
+#define VMM_TEMP_PAGE       0xCFFFF000
+
+// Window below VMM_TEMP_PAGE where drivers map device registers and firmware tables.
+#define VMM_DEVICE_BASE     0xCFFE0000
+#define VMM_DEVICE_END      VMM_TEMP_PAGE
+
+// The last directory slots map the page directories onto themselves (one slot per
+// directory page). Once paging is enabled, the page table for directory slot i is
+// visible at VMM_PAGE_TABLES + i * PAGE_SIZE and the directory entries from
+// VMM_PAGE_DIRECTORY on, so the top 4 MiB (8 MiB with PAE) of the address space is
+// reserved.
+#define VMM_RECURSIVE_SLOT  (VMM_DIR_SLOTS - VMM_DIR_PAGES)
+#if VMM_USE_PAE
+#define VMM_PAGE_TABLES     0xFF800000
+#define VMM_PAGE_DIRECTORY  0xFFFFC000
+#else
+#define VMM_PAGE_TABLES     0xFFC00000
+#define VMM_PAGE_DIRECTORY  0xFFFFF000
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Virtual address of the PDE covering 'virtual_addr' (paging must be enabled).
+static inline vmm_entry_t* vmm_pde_addr(uint32_t virtual_addr)
+{
+    return (vmm_entry_t*)VMM_PAGE_DIRECTORY + (virtual_addr >> PDE_SHIFT);
+}
+
+// Virtual address of the PTE for 'virtual_addr'. Only valid while the covering PDE is
+// present and not a large page.
+static inline vmm_entry_t* vmm_pte_addr(uint32_t virtual_addr)
+{
+    return (vmm_entry_t*)VMM_PAGE_TABLES + (virtual_addr >> 12);
+}
+
 void vmm_init();
 void vmm_enable();
 
 /*
  * vmm_map: Example function to map one page [virt -> phys].
  * In identity mapping, virt == phys, so you may not need this.
- * But we show it for completeness.
+ * But we show it for completeness. Missing page tables are allocated on demand.
+ * Returns 1 on success, 0 if no frame was available for a page table.
+ * Like every call below that edits page tables, it needs paging enabled: tables are
+ * reached through the recursive mapping.
  */
-void vmm_map(uint32_t virtual_addr, uint32_t physical_addr, int rw);
+int vmm_map(uint32_t virtual_addr, uint32_t physical_addr, int rw);
+
+// Remove the mapping for one page. Returns the physical address it pointed to, or 0.
+uint32_t vmm_unmap(uint32_t virtual_addr);
+
+// Frame-number variants of vmm_map/vmm_unmap. With PAE they reach frames above 4 GiB,
+// which a 32-bit physical address cannot name. vmm_unmap_pfn returns 0 if nothing was
+// mapped.
+int vmm_map_pfn(uint32_t virtual_addr, uint32_t pfn, int rw);
+uint32_t vmm_unmap_pfn(uint32_t virtual_addr);
+
+// Map one page of device registers: writable and uncached. Undo with vmm_unmap.
+int vmm_map_mmio(uint32_t virtual_addr, uint32_t physical_addr);
+
+// True if the identity map uses large pages.
+int vmm_large_pages_enabled();
+
+// Drop all non-global TLB entries (a CR3 reload).
+void vmm_flush_tlb();
+
+// Drop every TLB entry, global kernel mappings included. Only needed when kernel
+// mappings change in ways invlpg does not cover, e.g. after rewriting many PDEs.
+void vmm_flush_tlb_all();
+
+// Above this many pages, range operations flush the whole TLB instead of using invlpg.
+#define VMM_FLUSH_THRESHOLD 32
+
+// Map [virtual_addr, virtual_addr + size) to the physically contiguous range starting at
+// physical_addr, allocating page tables as needed, with one TLB invalidation pass at the
+// end. Returns 1 on success; on failure nothing of the range stays mapped and 0 is
+// returned.
+int vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, int rw);
+
+// The same, starting at frame number 'pfn', so the range may lie above 4 GiB with PAE.
+int vmm_map_range_pfn(uint32_t virtual_addr, uint32_t pfn, uint32_t size, int rw);
+
+// Unmap [virtual_addr, virtual_addr + size) with one invalidation pass. If pfn_out is not
+// NULL it receives the old frame number of every page (0 where none was mapped).
+// Returns the number of pages that were mapped.
+uint32_t vmm_unmap_range(uint32_t virtual_addr, uint32_t size, uint32_t* pfn_out);
+
+// Make a mapped page writable (rw = 1) or read-only (rw = 0). Returns 0 if it is not
+// mapped.
+int vmm_protect(uint32_t virtual_addr, int rw);
+
+// Physical address 'virtual_addr' maps to, or 0 if it is not mapped (or lies above 4 GiB).
+uint32_t vmm_translate(uint32_t virtual_addr);
+
+// Physical address of the current page directory, or of the page-directory-pointer
+// table with PAE (CR3).
+uint32_t vmm_current_directory();
+
+// Load another page directory, refreshing its shared slots from the master copy first.
+void vmm_switch_directory(uint32_t directory);
+
+// Create a new address space from the current one. Shared slots are linked, private
+// page tables are copied and every mapped frame in them is shared read-only until one
+// side writes to it. Returns the new directory's physical address, 0 if out of memory.
+uint32_t vmm_clone_directory();
+
+// Free a directory that is not loaded, with its private tables, dropping its reference
+// to every frame they map.
+void vmm_destroy_directory(uint32_t directory);
+
+// Pages copied so far by copy-on-write faults.
+extern uint32_t vmm_cow_copies;
+
+// Fill frame 'pfn' with zeroes, through VMM_TEMP_PAGE if it is not identity-mapped.
+// Frames above the identity map need paging enabled and interrupts disabled by the caller.
+void vmm_zero_pfn(uint32_t pfn);
 
 #ifdef __cplusplus
 }
@@ -6,5 +6,6 @@
 void pic_remap();
 void pic_send_eoi(uint8_t irq);
 void pic_unmask_irq(uint8_t irq);
+void pic_disable();
 void init_pic();
 #endif // PIC_H
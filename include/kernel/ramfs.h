@@ -38,6 +38,7 @@ extern FileDescriptor fd_table[MAX_OPEN_FILES];
 
 // Filesystem interface.
 FSNode* fs_create_node(const char* name, FSNodeType type);
+void fs_destroy_node(FSNode* node); // Frees the node, its data and any children
 void fs_add_child(FSNode* parent, FSNode* child);
 void fs_remove_child(FSNode* parent, FSNode* child);
 FSNode* fs_find_child(FSNode* parent, const char* name);
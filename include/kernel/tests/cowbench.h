@@ -0,0 +1,8 @@
+#ifndef KERNEL_COWBENCH_H
+#define KERNEL_COWBENCH_H
+
+// Clone an address space with a populated private region, time the clone and a
+// copy-on-write fault, and check that parent and child see their own data.
+void cow_benchmark();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef KERNEL_IRQBENCH_H
+#define KERNEL_IRQBENCH_H
+
+// Raise a software interrupt in a loop, once through a copy of the original IRQ entry path
+// and once through irq_common_stub, and compare the cycles per round trip.
+void irq_benchmark();
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef KERNEL_PMMBENCH_H
+#define KERNEL_PMMBENCH_H
+
+#include <stdint.h>
+
+// Fill up to 'frames' frames of low memory (ZONE_DMA), then compare the cycles per free-frame search of the summary
+// bitmap against the original linear scan.
+void pmm_benchmark(uint32_t frames);
+
+#endif
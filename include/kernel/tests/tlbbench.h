@@ -0,0 +1,8 @@
+#ifndef KERNEL_TLBBENCH_H
+#define KERNEL_TLBBENCH_H
+
+// Touch random pages of the identity-mapped range, once through the identity map and once
+// through a 4 KiB-page alias of the same memory, and compare the cycles per access.
+void tlb_benchmark();
+
+#endif
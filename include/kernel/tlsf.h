@@ -0,0 +1,38 @@
+#ifndef TLSF_H
+#define TLSF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Two-level segregated fit allocator: O(1) malloc/free over a single memory pool.
+// Free blocks are kept in 2^FL x 16 size-segregated lists indexed by two bitmaps, and
+// every block carries a boundary tag so it can merge with both physical neighbours.
+
+void tlsf_init(void* pool, size_t size);
+
+// Append 'size' bytes of memory that directly follow the current end of the pool.
+void tlsf_grow(size_t size);
+
+// Payload size of the last block in the pool if it is free, 0 otherwise.
+size_t tlsf_trailing_free();
+
+// Cut 'size' bytes off the end of the pool. The caller guarantees the trailing free
+// block is at least 'size' + 16 bytes, e.g. by checking tlsf_trailing_free() first.
+void tlsf_shrink(size_t size);
+void* tlsf_malloc(size_t size);
+void* tlsf_memalign(size_t align, size_t size);
+void tlsf_free(void* ptr);
+
+// Grow or shrink an allocated block without moving it. Growth absorbs the physically
+// next block if it is free; any excess is split off and returned to the free lists.
+// Returns 1 on success, 0 if the block cannot be resized in place.
+int tlsf_resize(void* ptr, size_t size);
+
+// Call 'walker' for every block in the pool, in address order.
+typedef void (*tlsf_walker_t)(void* ptr, size_t size, int used, void* user);
+void tlsf_walk(tlsf_walker_t walker, void* user);
+
+// Usable payload size of an allocated block.
+size_t tlsf_block_size(void* ptr);
+
+#endif
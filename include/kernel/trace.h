@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+// Compile-time trace levels. A KTRACE call whose level is above its subsystem's
+// configured level is a constant-false branch and compiles to nothing.
+#define TRACE_LEVEL_NONE   0
+#define TRACE_LEVEL_ERROR  1
+#define TRACE_LEVEL_INFO   2  // One-off messages such as init banners
+#define TRACE_LEVEL_DEBUG  3  // Per-call diagnostics on hot paths
+
+// Default for every subsystem. `make debug` raises it to TRACE_LEVEL_DEBUG.
+#ifndef TRACE_DEFAULT
+#define TRACE_DEFAULT TRACE_LEVEL_INFO
+#endif
+
+// Per-subsystem levels, e.g. `make TRACE_FLAGS=-DTRACE_HEAP=3` to trace only the heap.
+#ifndef TRACE_HEAP
+#define TRACE_HEAP TRACE_DEFAULT
+#endif
+
+#ifndef TRACE_VMM
+#define TRACE_VMM TRACE_DEFAULT
+#endif
+
+#ifndef TRACE_PMM
+#define TRACE_PMM TRACE_DEFAULT
+#endif
+
+#ifndef TRACE_RAMFS
+#define TRACE_RAMFS TRACE_DEFAULT
+#endif
+
+template <int Configured, int Level>
+constexpr bool trace_enabled() {
+    return Level <= Configured;
+}
+
+// KTRACE(HEAP, DEBUG, "[HEAP] Allocated %d bytes\n", size);
+#define KTRACE(subsys, level, ...)                                         \
+    do {                                                                   \
+        if constexpr (trace_enabled<TRACE_##subsys, TRACE_LEVEL_##level>()) { \
+            printf(__VA_ARGS__);                                           \
+        }                                                                  \
+    } while (0)
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include <stdint.h>
+
+// Virtual memory areas: ranges of kernel address space that are backed lazily. Nothing
+// is mapped when an area is registered; the first access to each page faults, and the
+// page fault handler maps a zeroed frame there and resumes the faulting instruction.
+
+#define VMA_MAX    16
+
+// Flags for vma_register
+#define VMA_WRITE  0x1  // Pages are mapped writable
+
+// Optional filter for sparse areas: return false for addresses inside the area that
+// must still fault (e.g. pages its owner has not handed out).
+typedef bool (*vma_check_t)(uint32_t addr);
+
+typedef struct vma {
+    uint32_t start;
+    uint32_t end;        // Exclusive
+    uint32_t flags;
+    vma_check_t check;   // May be NULL
+    uint32_t faults;     // Pages populated on demand
+} vma_t;
+
+// Register [start, start + size), page-aligned. Returns 0 if it overlaps an existing
+// area or the table is full.
+int vma_register(uint32_t start, uint32_t size, uint32_t flags, vma_check_t check);
+
+// Drop the area starting at 'start'. Pages already populated stay mapped; releasing
+// them is up to the owner.
+void vma_unregister(uint32_t start);
+
+// Area containing 'addr', or NULL.
+const vma_t* vma_find(uint32_t addr);
+
+// Try to resolve a fault at 'addr' by populating its page. Returns 1 if the faulting
+// access can be retried, 0 if the fault is not ours to fix.
+int vma_handle_fault(uint32_t addr, uint32_t err_code);
+
+// Registered areas in address order; returns their count.
+uint32_t vma_list(const vma_t** areas);
+
+#endif
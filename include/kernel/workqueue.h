@@ -0,0 +1,62 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deferred work: an IRQ handler does the minimum with the device (read the scancode,
+// acknowledge the interrupt) and queues the rest, which the idle loop in kernel_main runs
+// later with interrupts enabled. Long work then no longer holds off the timer.
+//
+// Each queue is a fixed ring with a sequence number per slot. Producers claim a slot with
+// a compare-and-swap on 'tail', so an IRQ may queue work while code it interrupted is
+// halfway through queueing its own; only the idle loop consumes.
+
+#define WORKQUEUE_SIZE  64  // Slots per queue, a power of two
+#define WORK_DATA_SIZE  12  // Bytes of payload copied into each item
+
+typedef void (*work_fn_t)(const void* data);
+
+typedef struct work_item {
+    volatile uint32_t seq;       // Slot state, see workqueue.cpp
+    work_fn_t fn;
+    uint64_t queued_at;          // rdtsc() when queued
+    uint8_t data[WORK_DATA_SIZE];
+} work_item_t;
+
+typedef struct workqueue {
+    const char* name;
+    work_item_t items[WORKQUEUE_SIZE];
+    volatile uint32_t head;      // Next item to run
+    volatile uint32_t tail;      // Next slot to claim
+
+    // Statistics. Latency runs from queueing to the start of the work function, in TSC
+    // cycles; the average is a moving average over roughly the last 8 items.
+    volatile uint32_t queued;
+    volatile uint32_t dropped;   // Queue was full
+    uint32_t run;
+    uint32_t max_depth;
+    uint32_t latency_avg;
+    uint32_t latency_max;
+    uint32_t work_max;           // Longest single work function, in cycles
+    struct workqueue* next;      // All queues, for workqueue_list
+} workqueue_t;
+
+// Set up 'wq' and add it to the queues the idle loop drains.
+void workqueue_init(workqueue_t* wq, const char* name);
+
+// Queue fn(data) with 'len' bytes of 'data' copied into the item. Safe from IRQ
+// handlers. Returns false if the queue is full or 'len' exceeds WORK_DATA_SIZE.
+bool work_queue(workqueue_t* wq, work_fn_t fn, const void* data, size_t len);
+
+// Run everything queued on every queue, with interrupts enabled. Only the idle loop calls
+// this. Returns the number of items run.
+uint32_t workqueue_run_all();
+
+// True if any queue has work waiting.
+bool workqueue_pending();
+
+// First queue in the list of all queues (follow ->next).
+workqueue_t* workqueue_list();
+
+#endif
@@ -0,0 +1,513 @@
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/idt.h>
+#include <kernel/isr.h>
+#include <kernel/paging.h>
+#include <kernel/pic.h>
+#include <kernel/port_io.h>
+#include <stdio.h>
+#include <string.h>
+
+// Local APIC registers (byte offsets into its 4 KiB register page)
+#define LAPIC_ID         0x020
+#define LAPIC_TPR        0x080
+#define LAPIC_EOI        0x0B0
+#define LAPIC_SVR        0x0F0
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_LVT_LINT0  0x350
+#define LAPIC_LVT_ERROR  0x370
+
+#define LAPIC_SVR_ENABLE 0x100
+#define LVT_MASKED       (1u << 16)
+
+// I/O APIC registers are reached through a select/window pair
+#define IOAPIC_REGSEL    0      // Word offsets
+#define IOAPIC_WINDOW    4
+#define IOAPIC_VERSION   0x01
+#define IOAPIC_REDTBL    0x10   // Two registers per redirection entry
+
+#define REDIR_ACTIVE_LOW (1u << 13)
+#define REDIR_LEVEL      (1u << 15)
+#define REDIR_MASKED     (1u << 16)
+
+#define ISA_IRQS         16
+#define IRQ_VECTOR_BASE  32
+
+// Layout of VMM_DEVICE_BASE: a window for firmware tables, then the register pages.
+#define FIRMWARE_WINDOW  VMM_DEVICE_BASE
+#define FIRMWARE_PAGES   16
+#define LAPIC_VIRT       (FIRMWARE_WINDOW + FIRMWARE_PAGES * PAGE_SIZE)
+#define IOAPIC_VIRT      (LAPIC_VIRT + PAGE_SIZE)
+
+// BIOS data area words
+#define BDA_EBDA_SEGMENT 0x40E
+#define BDA_BASE_MEMORY  0x413  // KiB of base memory
+
+// IMCR (interrupt mode configuration register) on MP systems that boot in PIC mode
+#define IMCR_SELECT      0x22
+#define IMCR_DATA        0x23
+
+extern "C" void lapic_spurious();
+
+static volatile uint32_t* lapic = NULL;
+static uint32_t lapic_phys = 0;
+static uint8_t boot_lapic_id = 0;
+static ioapic_t ioapics[IOAPIC_MAX];
+static uint32_t ioapic_count = 0;
+static bool has_imcr = false;
+static bool enabled = false;
+
+// ISA IRQ wiring: identity unless the firmware reports an override (typically the PIT,
+// IRQ0, on GSI 2).
+static uint32_t isa_gsi[ISA_IRQS];
+static uint16_t isa_flags[ISA_IRQS];
+
+static uint32_t firmware_pages = 0;
+
+static inline uint32_t get32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint16_t get16(const uint8_t* p)
+{
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(const ioapic_t* io, uint32_t reg)
+{
+    io->regs[IOAPIC_REGSEL] = reg;
+    return io->regs[IOAPIC_WINDOW];
+}
+
+static void ioapic_write(const ioapic_t* io, uint32_t reg, uint32_t value)
+{
+    io->regs[IOAPIC_REGSEL] = reg;
+    io->regs[IOAPIC_WINDOW] = value;
+}
+
+static void lapic_eoi(uint32_t vector)
+{
+    (void)vector;
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static bool checksum_ok(const uint8_t* p, uint32_t len)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum == 0;
+}
+
+static void firmware_unmap()
+{
+    for (uint32_t i = 0; i < firmware_pages; i++) {
+        vmm_unmap(FIRMWARE_WINDOW + i * PAGE_SIZE);
+    }
+    firmware_pages = 0;
+}
+
+// Firmware tables can sit anywhere in physical memory. Those outside the identity map
+// are viewed through FIRMWARE_WINDOW, one at a time: each call replaces the last view.
+static const uint8_t* firmware_map(uint32_t phys, uint32_t len)
+{
+    if (phys + len > phys && phys + len <= VMM_IDENTITY_LIMIT) {
+        return (const uint8_t*)phys;
+    }
+
+    firmware_unmap();
+    uint32_t offset = phys & (PAGE_SIZE - 1);
+    uint32_t pages = (offset + len + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages > FIRMWARE_PAGES) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < pages; i++) {
+        if (!vmm_map(FIRMWARE_WINDOW + i * PAGE_SIZE, phys - offset + i * PAGE_SIZE, 0)) {
+            firmware_pages = i;
+            firmware_unmap();
+            return NULL;
+        }
+    }
+    firmware_pages = pages;
+    return (const uint8_t*)(FIRMWARE_WINDOW + offset);
+}
+
+// Find a 16-byte aligned structure starting with 'sig' whose first 'sum_len' bytes
+// checksum to zero.
+static const uint8_t* scan(uint32_t start, uint32_t len, const char* sig, uint32_t sum_len)
+{
+    uint32_t sig_len = strlen(sig);
+    for (uint32_t p = start; p + sum_len <= start + len; p += 16) {
+        const uint8_t* candidate = (const uint8_t*)p;
+        if (memcmp(candidate, sig, sig_len) == 0 && checksum_ok(candidate, sum_len)) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+// Firmware structures live in the first KiB of the EBDA or in the BIOS ROM area; the MP
+// floating pointer may also sit in the last KiB of base memory.
+static const uint8_t* scan_bios(const char* sig, uint32_t sum_len, bool base_memory)
+{
+    uint32_t ebda = (uint32_t)get16((const uint8_t*)BDA_EBDA_SEGMENT) << 4;
+    const uint8_t* found = NULL;
+    if (ebda) {
+        found = scan(ebda, 1024, sig, sum_len);
+    }
+    if (!found && base_memory) {
+        uint32_t base_kb = get16((const uint8_t*)BDA_BASE_MEMORY);
+        if (base_kb >= 1) {
+            found = scan((base_kb - 1) * 1024, 1024, sig, sum_len);
+        }
+    }
+    if (!found) {
+        found = scan(0xE0000, 0x20000, sig, sum_len);
+    }
+    return found;
+}
+
+static ioapic_t* ioapic_for(uint32_t gsi)
+{
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].count) {
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+// Map an I/O APIC's registers and read how many inputs it has. The MP table does not
+// give GSI bases, so there 'gsi_base' is ~0u and the inputs follow the previous chip's.
+static void add_ioapic(uint8_t id, uint32_t phys, uint32_t gsi_base)
+{
+    if (ioapic_count == IOAPIC_MAX) {
+        printf("[APIC] Ignoring I/O APIC %d: only %d supported\n", id, IOAPIC_MAX);
+        return;
+    }
+    uint32_t virt = IOAPIC_VIRT + ioapic_count * PAGE_SIZE;
+    if (!vmm_map_mmio(virt, phys & ~(PAGE_SIZE - 1))) {
+        return;
+    }
+
+    ioapic_t* io = &ioapics[ioapic_count];
+    io->id = id;
+    io->phys = phys;
+    io->regs = (volatile uint32_t*)(virt + (phys & (PAGE_SIZE - 1)));
+    io->count = ((ioapic_read(io, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+    if (gsi_base == ~0u) {
+        gsi_base = ioapic_count ? ioapics[ioapic_count - 1].gsi_base + ioapics[ioapic_count - 1].count : 0;
+    }
+    io->gsi_base = gsi_base;
+    ioapic_count++;
+}
+
+// ACPI: RSDP -> RSDT -> MADT ("APIC").
+static const uint8_t* acpi_map_table(uint32_t phys, const char* sig)
+{
+    const uint8_t* header = firmware_map(phys, 36);
+    if (!header || memcmp(header, sig, 4) != 0) {
+        return NULL;
+    }
+    uint32_t len = get32(header + 4);
+    const uint8_t* table = firmware_map(phys, len);
+    if (!table || !checksum_ok(table, len)) {
+        return NULL;
+    }
+    return table;
+}
+
+static bool parse_madt()
+{
+    const uint8_t* rsdp = scan_bios("RSD PTR ", 20, false);
+    if (!rsdp) {
+        return false;
+    }
+    const uint8_t* rsdt = acpi_map_table(get32(rsdp + 16), "RSDT");
+    if (!rsdt) {
+        return false;
+    }
+
+    // Copy the table pointers out: looking at each table remaps the window.
+    uint32_t tables[32];
+    uint32_t table_count = (get32(rsdt + 4) - 36) / 4;
+    if (table_count > 32) {
+        table_count = 32;
+    }
+    memcpy(tables, rsdt + 36, table_count * 4);
+
+    const uint8_t* madt = NULL;
+    for (uint32_t i = 0; i < table_count && !madt; i++) {
+        madt = acpi_map_table(tables[i], "APIC");
+    }
+    if (!madt) {
+        firmware_unmap();
+        return false;
+    }
+
+    lapic_phys = get32(madt + 36);
+    uint32_t len = get32(madt + 4);
+    for (uint32_t off = 44; off + 2 <= len && madt[off + 1] >= 2; off += madt[off + 1]) {
+        const uint8_t* entry = madt + off;
+        switch (entry[0]) {
+        case 1:  // I/O APIC
+            add_ioapic(entry[2], get32(entry + 4), get32(entry + 8));
+            break;
+        case 2:  // Interrupt source override
+            if (entry[2] == 0 && entry[3] < ISA_IRQS) {
+                isa_gsi[entry[3]] = get32(entry + 4);
+                isa_flags[entry[3]] = get16(entry + 8);
+            }
+            break;
+        case 5:  // 64-bit local APIC address override
+            if (get32(entry + 8) == 0) {
+                lapic_phys = get32(entry + 4);
+            }
+            break;
+        }
+    }
+    firmware_unmap();
+    return lapic_phys && ioapic_count;
+}
+
+// MP specification: floating pointer -> configuration table.
+static bool parse_mp_table()
+{
+    const uint8_t* fp = scan_bios("_MP_", 16, true);
+    if (!fp) {
+        return false;
+    }
+    has_imcr = (fp[12] & 0x80) != 0;
+
+    if (fp[11] != 0) {
+        // One of the default configurations: a single I/O APIC, ISA IRQs wired 1:1.
+        lapic_phys = 0xFEE00000;
+        add_ioapic(1, 0xFEC00000, 0);
+        return ioapic_count != 0;
+    }
+
+    uint32_t config = get32(fp + 4);
+    const uint8_t* header = firmware_map(config, 44);
+    if (!header || memcmp(header, "PCMP", 4) != 0) {
+        firmware_unmap();
+        return false;
+    }
+    uint32_t len = get16(header + 4);
+    const uint8_t* table = firmware_map(config, len);
+    if (!table || !checksum_ok(table, len)) {
+        firmware_unmap();
+        return false;
+    }
+
+    lapic_phys = get32(table + 0x24);
+    uint32_t entries = get16(table + 0x22);
+    int isa_bus = -1;
+    uint32_t off = 44;
+    for (uint32_t i = 0; i < entries && off < len; i++) {
+        const uint8_t* entry = table + off;
+        if (entry[0] == 0) {  // Processor entries are the only long ones
+            off += 20;
+            continue;
+        }
+        switch (entry[0]) {
+        case 1:  // Bus
+            if (memcmp(entry + 2, "ISA", 3) == 0) {
+                isa_bus = entry[1];
+            }
+            break;
+        case 2:  // I/O APIC
+            if (entry[3] & 1) {
+                add_ioapic(entry[1], get32(entry + 4), ~0u);
+            }
+            break;
+        case 3:  // I/O interrupt assignment
+            if (entry[1] == 0 && entry[4] == isa_bus && entry[5] < ISA_IRQS) {
+                for (uint32_t j = 0; j < ioapic_count; j++) {
+                    if (ioapics[j].id == entry[6]) {
+                        isa_gsi[entry[5]] = ioapics[j].gsi_base + entry[7];
+                        isa_flags[entry[5]] = get16(entry + 2);
+                    }
+                }
+            }
+            break;
+        }
+        off += 8;
+    }
+    firmware_unmap();
+    return lapic_phys && ioapic_count;
+}
+
+static void reset_wiring()
+{
+    firmware_unmap();
+    for (uint32_t irq = 0; irq < ISA_IRQS; irq++) {
+        isa_gsi[irq] = irq;
+        isa_flags[irq] = 0;
+    }
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        vmm_unmap(IOAPIC_VIRT + i * PAGE_SIZE);
+    }
+    ioapic_count = 0;
+    lapic_phys = 0;
+    has_imcr = false;
+}
+
+// Map and enable the local APIC. Returns false, with the APIC untouched, if its
+// registers cannot be mapped.
+static bool lapic_enable()
+{
+    if (!vmm_map_mmio(LAPIC_VIRT, lapic_phys & ~(PAGE_SIZE - 1))) {
+        return false;
+    }
+    if (cpu_has_edx_features(CPUID_FEAT_EDX_MSR)) {
+        uint64_t base = rdmsr(MSR_APIC_BASE);
+        if (!(base & MSR_APIC_BASE_ENABLE)) {
+            wrmsr(MSR_APIC_BASE, base | MSR_APIC_BASE_ENABLE);
+        }
+    }
+
+    lapic = (volatile uint32_t*)(LAPIC_VIRT + (lapic_phys & (PAGE_SIZE - 1)));
+    boot_lapic_id = lapic_read(LAPIC_ID) >> 24;
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);  // The 8259's virtual-wire input
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    return true;
+}
+
+int apic_init()
+{
+    if (!cpu_has_edx_features(CPUID_FEAT_EDX_APIC)) {
+        printf("[APIC] No local APIC, keeping the 8259\n");
+        return 0;
+    }
+
+    reset_wiring();
+    const char* source = "ACPI MADT";
+    bool found = parse_madt();
+    if (!found) {
+        reset_wiring();
+        source = "MP table";
+        found = parse_mp_table();
+    }
+    if (!found) {
+        reset_wiring();
+        printf("[APIC] No I/O APIC described by firmware, keeping the 8259\n");
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    if (!lapic_enable()) {
+        irq_restore(flags);
+        reset_wiring();
+        printf("[APIC] Could not map the local APIC, keeping the 8259\n");
+        return 0;
+    }
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)lapic_spurious, 0x08, 0x8E);
+
+    // Every ISA IRQ keeps its 8259 vector and starts masked. Overridden IRQs go last so
+    // they win over the identity entry for the same GSI (IRQ0 over the unused IRQ2).
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t irq = 0; irq < ISA_IRQS; irq++) {
+            if ((isa_gsi[irq] != irq) == (pass == 1)) {
+                ioapic_route(isa_gsi[irq], IRQ_VECTOR_BASE + irq, isa_flags[irq], true);
+            }
+        }
+    }
+
+    pic_disable();
+    if (has_imcr) {
+        outb(IMCR_SELECT, 0x70);
+        outb(IMCR_DATA, 0x01);  // Send INTR through the APIC instead of straight to the CPU
+    }
+    enabled = true;
+    irq_set_eoi(lapic_eoi);
+    irq_restore(flags);
+
+    printf("[APIC] Local APIC at 0x%x, %d I/O APIC(s) from the %s\n", lapic_phys, ioapic_count, source);
+    return 1;
+}
+
+bool apic_enabled()
+{
+    return enabled;
+}
+
+int ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags, bool masked)
+{
+    ioapic_t* io = ioapic_for(gsi);
+    if (!io) {
+        return 0;
+    }
+
+    uint32_t low = vector;
+    if ((flags & APIC_POLARITY_MASK) == APIC_POLARITY_LOW) {
+        low |= REDIR_ACTIVE_LOW;
+    }
+    if ((flags & APIC_TRIGGER_MASK) == APIC_TRIGGER_LEVEL) {
+        low |= REDIR_LEVEL;
+    }
+    if (masked) {
+        low |= REDIR_MASKED;
+    }
+
+    uint32_t reg = IOAPIC_REDTBL + 2 * (gsi - io->gsi_base);
+    uint32_t irq_flags = irq_save();
+    ioapic_write(io, reg, REDIR_MASKED);  // Never live with a half-written entry
+    ioapic_write(io, reg + 1, (uint32_t)boot_lapic_id << 24);
+    ioapic_write(io, reg, low);
+    irq_restore(irq_flags);
+    return 1;
+}
+
+void ioapic_set_mask(uint32_t gsi, bool masked)
+{
+    ioapic_t* io = ioapic_for(gsi);
+    if (!io) {
+        return;
+    }
+    uint32_t reg = IOAPIC_REDTBL + 2 * (gsi - io->gsi_base);
+    uint32_t irq_flags = irq_save();
+    uint32_t low = ioapic_read(io, reg);
+    ioapic_write(io, reg, masked ? (low | REDIR_MASKED) : (low & ~REDIR_MASKED));
+    irq_restore(irq_flags);
+}
+
+uint32_t apic_isa_gsi(uint8_t irq)
+{
+    return irq < ISA_IRQS ? isa_gsi[irq] : irq;
+}
+
+void apic_mask_irq(uint8_t irq)
+{
+    ioapic_set_mask(apic_isa_gsi(irq), true);
+}
+
+void apic_unmask_irq(uint8_t irq)
+{
+    ioapic_set_mask(apic_isa_gsi(irq), false);
+}
+
+uint32_t ioapic_list(const ioapic_t** list)
+{
+    *list = ioapics;
+    return ioapic_count;
+}
@@ -0,0 +1,159 @@
+#include <kernel/bitmap.h>
+#include <string.h>
+
+uint32_t SummaryBitmap::words_needed(uint32_t bits) {
+    uint32_t total = 0;
+    uint32_t entries = bits;
+    int level = 0;
+    do {
+        entries = (entries + 31) / 32;
+        if (entries == 0) {
+            entries = 1;
+        }
+        total += entries;
+        level++;
+    } while (entries > 1 && level < MAX_LEVELS);
+    return total;
+}
+
+void SummaryBitmap::init(uint32_t* storage, uint32_t bit_count, bool set_all) {
+    bits = bit_count;
+    hint = 0;
+    level_count = 0;
+
+    uint32_t entries = bits;
+    do {
+        uint32_t words = (entries + 31) / 32;
+        if (words == 0) {
+            words = 1;
+        }
+        levels[level_count] = storage;
+        level_words[level_count] = words;
+        memset(storage, set_all ? 0xFF : 0, words * sizeof(uint32_t));
+        storage += words;
+        level_count++;
+        entries = words;
+    } while (entries > 1 && level_count < MAX_LEVELS);
+
+    if (set_all) {
+        return;
+    }
+
+    // Padding bits past the last real entry of each level count as set, so a partial
+    // last word can still fill up and searches never return an index past the end.
+    entries = bits;
+    for (int level = 0; level < level_count; level++) {
+        for (uint32_t idx = entries; idx < level_words[level] * 32; idx++) {
+            uint32_t pos = idx;
+            for (int l = level; l < level_count; l++) {
+                uint32_t* word = &levels[l][pos / 32];
+                *word |= (1u << (pos % 32));
+                if (*word != 0xFFFFFFFF) {
+                    break;
+                }
+                pos /= 32;
+            }
+        }
+        entries = level_words[level];
+    }
+}
+
+void SummaryBitmap::set(uint32_t idx) {
+    set_at(0, idx);
+}
+
+void SummaryBitmap::clear(uint32_t idx) {
+    if (idx < hint) {
+        hint = idx;
+    }
+    clear_at(0, idx);
+}
+
+// Whole words in the middle of the range are written at once, with one summary update
+// per word instead of one per bit.
+void SummaryBitmap::set_range(uint32_t start, uint32_t count) {
+    uint32_t idx = start;
+    uint32_t end = start + count;
+    while (idx < end) {
+        if (idx % 32 == 0 && end - idx >= 32) {
+            levels[0][idx / 32] = 0xFFFFFFFF;
+            set_at(1, idx / 32);
+            idx += 32;
+        } else {
+            set_at(0, idx++);
+        }
+    }
+}
+
+void SummaryBitmap::clear_range(uint32_t start, uint32_t count) {
+    if (start < hint) {
+        hint = start;
+    }
+    uint32_t idx = start;
+    uint32_t end = start + count;
+    while (idx < end) {
+        if (idx % 32 == 0 && end - idx >= 32) {
+            levels[0][idx / 32] = 0;
+            clear_at(1, idx / 32);
+            idx += 32;
+        } else {
+            clear_at(0, idx++);
+        }
+    }
+}
+
+// Set a bit and, if that fills its word, the word's bit in the level above.
+void SummaryBitmap::set_at(int level, uint32_t idx) {
+    for (; level < level_count; level++) {
+        uint32_t* word = &levels[level][idx / 32];
+        *word |= (1u << (idx % 32));
+        if (*word != 0xFFFFFFFF) {
+            return;
+        }
+        idx /= 32;
+    }
+}
+
+// Clear a bit and, if its word was full, the word's bit in the level above.
+void SummaryBitmap::clear_at(int level, uint32_t idx) {
+    for (; level < level_count; level++) {
+        uint32_t* word = &levels[level][idx / 32];
+        bool was_full = (*word == 0xFFFFFFFF);
+        *word &= ~(1u << (idx % 32));
+        if (!was_full) {
+            return;
+        }
+        idx /= 32;
+    }
+}
+
+uint32_t SummaryBitmap::find_clear() {
+    uint32_t idx = find_clear_from(hint);
+    if (idx != UINT32_MAX) {
+        hint = idx;
+    }
+    return idx;
+}
+
+// Climbs the summary levels until a word with a clear bit at or after the current
+// position turns up, then descends with ctz.
+uint32_t SummaryBitmap::find_clear_from(uint32_t start) const {
+    uint32_t idx = start;
+    for (int level = 0; level < level_count; level++) {
+        uint32_t w = idx / 32;
+        if (w >= level_words[level]) {
+            return UINT32_MAX;
+        }
+        uint32_t clear_bits = ~levels[level][w] & (0xFFFFFFFF << (idx % 32));
+        if (clear_bits) {
+            idx = w * 32 + __builtin_ctz(clear_bits);
+            while (level-- > 0) {
+                idx = idx * 32 + __builtin_ctz(~levels[level][idx]);
+            }
+            return idx;
+        }
+        // Nothing left in this word: continue with the next word, one level up.
+        idx = w + 1;
+    }
+    return UINT32_MAX;
+}
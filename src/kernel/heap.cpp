@@ -1,96 +1,808 @@
 #include <kernel/heap.h>
-#include <kernel/memory.h>  // For KERNEL_HEAP_START and KERNEL_HEAP_SIZE
+#include <kernel/memory.h>  // For PhysicalMemoryManager
+#include <kernel/paging.h>
+#include <kernel/tlsf.h>
+#include <kernel/vma.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <kernel/trace.h>
 
-// Heap block header structure.
+#if !HEAP_USE_TLSF
+// Heap block header structure. Padded to 16 bytes so payloads stay 16-byte aligned.
 typedef struct heap_block {
     size_t size;                 // Size of the block (excluding the header)
     struct heap_block* next;     // Pointer to the next block in the free list
     uint8_t free;                // 1 if the block is free, 0 if it's allocated
-} heap_block_t;
+} __attribute__((aligned(16))) heap_block_t;
 
 // Global pointer to the start of the heap
-static heap_block_t* free_list = NULL;  
+static heap_block_t* free_list = NULL;
 
-// Align size to 16 bytes
-static size_t align16(size_t size) {
-    return (size + 15) & ~((size_t)15);
+// Physically last block; the heap grows and shrinks at its end.
+static heap_block_t* last_block = NULL;
+#endif
+
+static bool heap_ready = false;
+
+// End of the mapped part of the heap window.
+static uintptr_t heap_end = KERNEL_HEAP_START;
+
+// Running counters; the free-space fields are filled in by heap_get_stats.
+static heap_stats_t stats;
+
+// Slab header, stored at the start of every 4 KiB slab page.
+typedef struct slab {
+    struct slab* next;           // Next slab in the class's partial list
+    struct slab* prev;           // Previous slab in the class's partial list
+    void* free_objects;          // Singly linked list of free objects in this slab
+    uint16_t in_use;             // Number of objects handed out
+    uint16_t capacity;           // Number of objects that fit in the slab
+    uint8_t class_idx;           // Index into slab_class_sizes
+} slab_t;
+
+// Per size-class state: slabs that still have free objects, plus one cached empty slab.
+typedef struct slab_class {
+    slab_t* partial;
+    slab_t* empty;
+} slab_class_t;
+
+#define SLAB_PAGE_SIZE    4096
+#define SLAB_MAX_SIZE     1024
+#define SLAB_HEADER_SIZE  ((sizeof(slab_t) + 15) & ~((size_t)15))
+#define SLAB_NUM_CLASSES  (sizeof(slab_class_sizes) / sizeof(slab_class_sizes[0]))
+#define HEAP_PAGES        (KERNEL_HEAP_MAX_SIZE / SLAB_PAGE_SIZE)
+
+// Size classes: powers of two with an intermediate step to limit internal waste.
+static const uint16_t slab_class_sizes[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+static slab_class_t slab_classes[SLAB_NUM_CLASSES];
+
+// Maps (size + 15) / 16 to a size class, so lookup is a single table read.
+static uint8_t slab_class_lookup[SLAB_MAX_SIZE / 16 + 1];
+
+// One bit per heap page: set if the page is a slab page.
+static uint32_t slab_page_map[(HEAP_PAGES + 31) / 32];
+
+static void init_slabs() {
+    size_t cls = 0;
+    for (size_t i = 0; i < sizeof(slab_class_lookup); i++) {
+        while (slab_class_sizes[cls] < i * 16) {
+            cls++;
+        }
+        slab_class_lookup[i] = (uint8_t)cls;
+    }
+    memset(slab_classes, 0, sizeof(slab_classes));
+    memset(slab_page_map, 0, sizeof(slab_page_map));
+    memset(&stats, 0, sizeof(stats));
 }
 
+// Unmap [start, start + size) from the heap window and return the frames to the PMM.
+#define HEAP_MAP_BATCH 64  // Frames handled per bulk PMM call
+
+static void heap_unmap_pages(uintptr_t start, size_t size) {
+    uint32_t frames[HEAP_MAP_BATCH];
+    while (size) {
+        size_t chunk = size < HEAP_MAP_BATCH * PAGE_SIZE ? size : HEAP_MAP_BATCH * PAGE_SIZE;
+        uint32_t pages = chunk / PAGE_SIZE;
+        vmm_unmap_range(start, chunk, frames);
+
+        // Pack the mapped frames to the front; holes come back as 0.
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < pages; i++) {
+            if (frames[i]) {
+                frames[count++] = frames[i];
+            }
+        }
+        PhysicalMemoryManager::free_pfns_bulk(count, frames);
+        start += chunk;
+        size -= chunk;
+    }
+}
+
+// Back [start, start + size) of the heap window with fresh frames. Frames come from
+// the PMM in batches and every physically contiguous run is mapped in one go. They are
+// taken by frame number, so with PAE the heap can live above 4 GiB.
+static bool heap_map_pages(uintptr_t start, size_t size) {
+    uint32_t frames[HEAP_MAP_BATCH];
+    uintptr_t va = start;
+    while (va < start + size) {
+        size_t remaining = (start + size - va) / PAGE_SIZE;
+        uint32_t want = remaining < HEAP_MAP_BATCH ? remaining : HEAP_MAP_BATCH;
+        uint32_t got = PhysicalMemoryManager::allocate_pfns_bulk(want, frames);
+
+        uint32_t i = 0;
+        while (i < got) {
+            uint32_t run = 1;
+            while (i + run < got && frames[i + run] == frames[i] + run) {
+                run++;
+            }
+            if (!vmm_map_range_pfn(va, frames[i], run * PAGE_SIZE, 1)) {
+                PhysicalMemoryManager::free_pfns_bulk(got - i, frames + i);
+                heap_unmap_pages(start, va - start);
+                return false;
+            }
+            va += run * PAGE_SIZE;
+            i += run;
+        }
+
+        if (got < want) {
+            heap_unmap_pages(start, va - start);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool area_page_reserved(uint32_t addr);
+
 // Initialize the heap (must be called before using kmalloc)
 void init_heap() {
-    printf("[HEAP] Initializing heap at 0x%x, size 0x%x\n", KERNEL_HEAP_START, KERNEL_HEAP_SIZE);
-    
+    KTRACE(HEAP, INFO, "[HEAP] Initializing heap at 0x%x, size 0x%x (max 0x%x)\n",
+           KERNEL_HEAP_START, KERNEL_HEAP_INITIAL_SIZE, KERNEL_HEAP_MAX_SIZE);
+
+    if (!heap_map_pages(KERNEL_HEAP_START, KERNEL_HEAP_INITIAL_SIZE)) {
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Could not back the initial heap!\n");
+        return;
+    }
+    heap_end = KERNEL_HEAP_START + KERNEL_HEAP_INITIAL_SIZE;
+
+#if HEAP_USE_TLSF
+    tlsf_init((void*)KERNEL_HEAP_START, KERNEL_HEAP_INITIAL_SIZE);
+#else
     free_list = (heap_block_t*)KERNEL_HEAP_START;
-    free_list->size = KERNEL_HEAP_SIZE - sizeof(heap_block_t);
+    free_list->size = KERNEL_HEAP_INITIAL_SIZE - sizeof(heap_block_t);
     free_list->next = NULL;
     free_list->free = 1;
+    last_block = free_list;
+#endif
+
+    init_slabs();
+    vma_register(KERNEL_PAGE_AREA_START, KERNEL_PAGE_AREA_SIZE, VMA_WRITE, area_page_reserved);
+    heap_ready = true;
 }
 
-// Allocate memory from the heap
-void* kmalloc(size_t size) {
-    if (size == 0) {
-        return NULL;
+#if !HEAP_USE_TLSF
+// Align size to 16 bytes
+static size_t align16(size_t size) {
+    return (size + 15) & ~((size_t)15);
+}
+
+// Split 'block' so that exactly 'size' bytes stay in it, if the remainder is worth a block.
+static void block_split(heap_block_t* block, size_t size) {
+    if (block->size >= size + sizeof(heap_block_t) + 16) {
+        uintptr_t block_addr = (uintptr_t)block;
+        heap_block_t* new_block = (heap_block_t*)(block_addr + sizeof(heap_block_t) + size);
+        new_block->size = block->size - size - sizeof(heap_block_t);
+        new_block->next = block->next;
+        new_block->free = 1;
+        block->size = size;
+        block->next = new_block;
+        if (!new_block->next) {
+            last_block = new_block;
+        }
     }
+}
 
+// First-fit search for a block whose payload can start on an 'align' boundary.
+// A misaligned prefix is split off as its own free block instead of being wasted.
+static void* legacy_alloc(size_t size, size_t align) {
     size = align16(size); // Ensure 16-byte alignment
 
     if (!free_list) {
-        printf("[HEAP] Error: Heap is not initialized!\n");
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Heap is not initialized!\n");
         return NULL;
     }
 
     heap_block_t* current = free_list;
-    heap_block_t* previous = NULL;
+    uintptr_t payload = 0;
 
     // Find a free block that is big enough
     while (current != NULL) {
-        if (current->free && current->size >= size) {
-            break;
+        if (current->free) {
+            payload = (uintptr_t)current + sizeof(heap_block_t);
+            uintptr_t aligned = (payload + align - 1) & ~((uintptr_t)align - 1);
+            // The gap must be able to hold a free block of its own.
+            while (aligned != payload && aligned - payload < sizeof(heap_block_t) + 16) {
+                aligned += align;
+            }
+            if (aligned - payload + size <= current->size) {
+                payload = aligned;
+                break;
+            }
         }
-        previous = current;
         current = current->next;
     }
 
     if (current == NULL) {
-        printf("[HEAP] Error: No free block large enough for %d bytes!\n", size);
+        KTRACE(HEAP, DEBUG, "[HEAP] Error: No free block large enough for %d bytes!\n", size);
         return NULL;
     }
 
-    // Check if we can split the block
-    if (current->size >= size + sizeof(heap_block_t) + 16) {
-        uintptr_t block_addr = (uintptr_t)current;
-        heap_block_t* new_block = (heap_block_t*)(block_addr + sizeof(heap_block_t) + size);
-        new_block->size = current->size - size - sizeof(heap_block_t);
-        new_block->next = current->next;
-        new_block->free = 1;
-        current->size = size;
-        current->next = new_block;
+    uintptr_t start = (uintptr_t)current + sizeof(heap_block_t);
+    if (payload != start) {
+        heap_block_t* aligned_block = (heap_block_t*)(payload - sizeof(heap_block_t));
+        aligned_block->size = current->size - (payload - start);
+        aligned_block->next = current->next;
+        aligned_block->free = 1;
+        current->size = (uintptr_t)aligned_block - start;
+        current->next = aligned_block;
+        current = aligned_block;
+        if (!aligned_block->next) {
+            last_block = aligned_block;
+        }
     }
 
+    // Check if we can split the block
+    block_split(current, size);
+
     current->free = 0; // Mark block as used
     void* alloc_addr = (void*)((uintptr_t)current + sizeof(heap_block_t));
 
-    printf("[HEAP] Allocated %d bytes at 0x%x\n", size, (uint32_t)alloc_addr);
+    KTRACE(HEAP, DEBUG, "[HEAP] Allocated %d bytes at 0x%x\n", size, (uint32_t)alloc_addr);
     return alloc_addr;
 }
 
-// Free allocated memory
-void kfree(void* ptr) {
-    if (!ptr) return;
-
+static void legacy_free(void* ptr) {
     heap_block_t* block = (heap_block_t*)((uintptr_t)ptr - sizeof(heap_block_t));
     block->free = 1;
-    printf("[HEAP] Freed block at 0x%x (size: %d bytes)\n", (uint32_t)ptr, block->size);
+    KTRACE(HEAP, DEBUG, "[HEAP] Freed block at 0x%x (size: %d bytes)\n", (uint32_t)ptr, block->size);
 
     // Try to merge with next block if free
     if (block->next && block->next->free) {
         block->size += block->next->size + sizeof(heap_block_t);
         block->next = block->next->next;
+        if (!block->next) {
+            last_block = block;
+        }
+    }
+}
+
+// Resize a block in place: grow into the next block if it is free, then split off the tail.
+static int legacy_resize(void* ptr, size_t size) {
+    heap_block_t* block = (heap_block_t*)((uintptr_t)ptr - sizeof(heap_block_t));
+    size = align16(size);
+
+    if (size > block->size) {
+        heap_block_t* next = block->next;
+        if (!next || !next->free || block->size + sizeof(heap_block_t) + next->size < size) {
+            return 0;
+        }
+        block->size += next->size + sizeof(heap_block_t);
+        block->next = next->next;
+        if (!block->next) {
+            last_block = block;
+        }
+    }
+
+    block_split(block, size);
+    heap_block_t* tail = block->next;
+    if (tail && tail->free && tail->next && tail->next->free) {
+        tail->size += tail->next->size + sizeof(heap_block_t);
+        tail->next = tail->next->next;
+        if (!tail->next) {
+            last_block = tail;
+        }
+    }
+    return 1;
+}
+
+// Append 'size' freshly mapped bytes at the end of the heap.
+static void legacy_grow(size_t size) {
+    if (last_block->free) {
+        last_block->size += size;
+        return;
+    }
+    heap_block_t* block = (heap_block_t*)heap_end;
+    block->size = size - sizeof(heap_block_t);
+    block->next = NULL;
+    block->free = 1;
+    last_block->next = block;
+    last_block = block;
+}
+#endif
+
+// Extend the heap by at least 'min_bytes', pulling frames from the PMM.
+static bool heap_grow(size_t min_bytes) {
+    size_t size = (min_bytes + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+    if (size < KERNEL_HEAP_GROW_MIN) {
+        size = KERNEL_HEAP_GROW_MIN;
+    }
+    size_t room = KERNEL_HEAP_START + KERNEL_HEAP_MAX_SIZE - heap_end;
+    if (size > room) {
+        if (min_bytes > room) {
+            return false;
+        }
+        size = room;
+    }
+
+    if (!heap_map_pages(heap_end, size)) {
+        return false;
+    }
+
+#if HEAP_USE_TLSF
+    tlsf_grow(size);
+#else
+    legacy_grow(size);
+#endif
+    heap_end += size;
+    return true;
+}
+
+// Give a large free tail back to the PMM, keeping some slack to avoid grow/trim cycles.
+static void heap_trim() {
+#if HEAP_USE_TLSF
+    size_t tail = tlsf_trailing_free();
+#else
+    size_t tail = last_block->free ? last_block->size : 0;
+#endif
+    if (tail < KERNEL_HEAP_TRIM_MIN) {
+        return;
+    }
+
+    size_t release = (tail - KERNEL_HEAP_GROW_MIN) & ~((size_t)PAGE_SIZE - 1);
+    size_t shrinkable = heap_end - (KERNEL_HEAP_START + KERNEL_HEAP_INITIAL_SIZE);
+    if (release > shrinkable) {
+        release = shrinkable;
+    }
+    if (release == 0) {
+        return;
+    }
+
+#if HEAP_USE_TLSF
+    tlsf_shrink(release);
+#else
+    last_block->size -= release;
+#endif
+    heap_end -= release;
+    heap_unmap_pages(heap_end, release);
+}
+
+// Block allocator backend, selected at build time with HEAP_USE_TLSF.
+static void* backend_alloc(size_t size, size_t align) {
+#if HEAP_USE_TLSF
+    return tlsf_memalign(align, size);
+#else
+    return legacy_alloc(size, align);
+#endif
+}
+
+static void* block_alloc(size_t size, size_t align) {
+    void* ptr = backend_alloc(size, align);
+    // Out of space: grow by enough to hold the request plus headers and alignment slack.
+    if (!ptr && heap_grow(size + align + 64)) {
+        ptr = backend_alloc(size, align);
+    }
+    return ptr;
+}
+
+static void block_free(void* ptr) {
+#if HEAP_USE_TLSF
+    tlsf_free(ptr);
+#else
+    legacy_free(ptr);
+#endif
+    heap_trim();
+}
+
+static int block_resize(void* ptr, size_t size) {
+#if HEAP_USE_TLSF
+    return tlsf_resize(ptr, size);
+#else
+    return legacy_resize(ptr, size);
+#endif
+}
+
+static size_t block_size(void* ptr) {
+#if HEAP_USE_TLSF
+    return tlsf_block_size(ptr);
+#else
+    return ((heap_block_t*)((uintptr_t)ptr - sizeof(heap_block_t)))->size;
+#endif
+}
+
+static inline size_t slab_page_index(uintptr_t addr) {
+    return (addr - KERNEL_HEAP_START) / SLAB_PAGE_SIZE;
+}
+
+// Returns the slab owning 'ptr', or NULL if it came from the block allocator.
+static slab_t* slab_of(void* ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    if (addr < KERNEL_HEAP_START || addr >= heap_end) {
+        return NULL;
+    }
+    size_t page = slab_page_index(addr);
+    if (!(slab_page_map[page / 32] & (1u << (page % 32)))) {
+        return NULL;
+    }
+    return (slab_t*)(addr & ~((uintptr_t)SLAB_PAGE_SIZE - 1));
+}
+
+static void slab_list_push(slab_t** head, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(slab_t** head, slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = NULL;
+}
+
+// Carve a new slab page for class 'cls' out of the block allocator.
+static slab_t* slab_create(uint8_t cls) {
+    slab_t* slab = (slab_t*)block_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+    if (!slab) {
+        return NULL;
+    }
+
+    size_t obj_size = slab_class_sizes[cls];
+    slab->class_idx = cls;
+    slab->in_use = 0;
+    slab->capacity = (SLAB_PAGE_SIZE - SLAB_HEADER_SIZE) / obj_size;
+    slab->next = slab->prev = NULL;
+
+    // Thread every object onto the slab's free list.
+    uint8_t* obj = (uint8_t*)slab + SLAB_HEADER_SIZE;
+    slab->free_objects = NULL;
+    for (size_t i = slab->capacity; i > 0; i--) {
+        void** node = (void**)(obj + (i - 1) * obj_size);
+        *node = slab->free_objects;
+        slab->free_objects = node;
+    }
+
+    size_t page = slab_page_index((uintptr_t)slab);
+    slab_page_map[page / 32] |= (1u << (page % 32));
+    stats.slab_pages++;
+    return slab;
+}
+
+static void slab_destroy(slab_t* slab) {
+    size_t page = slab_page_index((uintptr_t)slab);
+    slab_page_map[page / 32] &= ~(1u << (page % 32));
+    stats.slab_pages--;
+    block_free(slab);
+}
+
+static void* slab_alloc(size_t size) {
+    uint8_t cls = slab_class_lookup[(size + 15) / 16];
+    slab_class_t* sc = &slab_classes[cls];
+
+    slab_t* slab = sc->partial;
+    if (!slab) {
+        if (sc->empty) {
+            slab = sc->empty;
+            sc->empty = NULL;
+        } else {
+            slab = slab_create(cls);
+            if (!slab) {
+                return NULL;
+            }
+        }
+        slab_list_push(&sc->partial, slab);
+    }
+
+    void** obj = (void**)slab->free_objects;
+    slab->free_objects = *obj;
+    slab->in_use++;
+
+    // A full slab leaves the partial list until an object comes back.
+    if (!slab->free_objects) {
+        slab_list_remove(&sc->partial, slab);
     }
+    return obj;
+}
+
+static void slab_free(slab_t* slab, void* ptr) {
+    slab_class_t* sc = &slab_classes[slab->class_idx];
+    bool was_full = (slab->free_objects == NULL);
+
+    void** obj = (void**)ptr;
+    *obj = slab->free_objects;
+    slab->free_objects = obj;
+    slab->in_use--;
+
+    if (was_full) {
+        slab_list_push(&sc->partial, slab);
+    }
+
+    // Keep one empty slab per class cached; give the rest back to the block allocator.
+    if (slab->in_use == 0) {
+        slab_list_remove(&sc->partial, slab);
+        if (!sc->empty) {
+            sc->empty = slab;
+        } else {
+            slab_destroy(slab);
+        }
+    }
+}
+
+
+#define AREA_PAGES  (KERNEL_PAGE_AREA_SIZE / PAGE_SIZE)
+
+// Page area bookkeeping: one bit per page that is in use, one bit marking the last page
+// of each allocation so kfree can recover its length without a header, and one bit per
+// page of kreserve_pages allocations, which the page fault handler populates.
+static uint32_t area_used[AREA_PAGES / 32];
+static uint32_t area_last[AREA_PAGES / 32];
+static uint32_t area_reserved[AREA_PAGES / 32];
+static size_t area_hint = 0;  // Next-fit starting point for the run search
+
+static inline bool bit_test(const uint32_t* map, size_t idx) {
+    return (map[idx / 32] >> (idx % 32)) & 1;
+}
+
+static inline void bit_set(uint32_t* map, size_t idx) {
+    map[idx / 32] |= (1u << (idx % 32));
+}
+
+static inline void bit_clear(uint32_t* map, size_t idx) {
+    map[idx / 32] &= ~(1u << (idx % 32));
+}
+
+static inline bool in_page_area(uintptr_t addr) {
+    return addr >= KERNEL_PAGE_AREA_START && addr < KERNEL_PAGE_AREA_START + KERNEL_PAGE_AREA_SIZE;
+}
+
+// VMA filter: only pages of live kreserve_pages allocations are populated on demand.
+// Every other page of the area is mapped up front, so a fault there is a real bug.
+static bool area_page_reserved(uint32_t addr) {
+    return bit_test(area_reserved, (addr - KERNEL_PAGE_AREA_START) / PAGE_SIZE);
+}
+
+// Find 'count' free pages starting on a multiple of 'align_pages', scanning from the hint
+// and wrapping once. Fully used words are skipped 32 pages at a time.
+static size_t area_find(size_t count, size_t align_pages) {
+    for (int pass = 0; pass < 2; pass++) {
+        size_t limit = pass == 0 ? AREA_PAGES : area_hint + count;
+        size_t i = pass == 0 ? area_hint : 0;
+        i = (i + align_pages - 1) & ~(align_pages - 1);
+
+        while (i + count <= AREA_PAGES && i < limit) {
+            if (i % 32 == 0 && area_used[i / 32] == 0xFFFFFFFF) {
+                i = (i + 32 + align_pages - 1) & ~(align_pages - 1);
+                continue;
+            }
+            size_t j = 0;
+            while (j < count && !bit_test(area_used, i + j)) {
+                j++;
+            }
+            if (j == count) {
+                return i;
+            }
+            i = (i + j + 1 + align_pages - 1) & ~(align_pages - 1);
+        }
+    }
+    return AREA_PAGES;
+}
+
+// Number of pages in the page-area allocation starting at page 'idx'.
+static size_t area_run_length(size_t idx) {
+    size_t end = idx;
+    while (!bit_test(area_last, end)) {
+        end++;
+    }
+    return end - idx + 1;
+}
+
+static void area_release(size_t idx, size_t count) {
+    uintptr_t va = KERNEL_PAGE_AREA_START + idx * PAGE_SIZE;
+    heap_unmap_pages(va, count * PAGE_SIZE);
+    for (size_t i = idx; i < idx + count; i++) {
+        bit_clear(area_used, i);
+        bit_clear(area_last, i);
+        bit_clear(area_reserved, i);
+    }
+    stats.area_pages -= count;
+}
+
+// Map 'count' pages at page index 'idx' and mark them used. Reserved pages are only
+// marked; the page fault handler backs them on first touch.
+static bool area_commit(size_t idx, size_t count, bool reserve) {
+    uintptr_t va = KERNEL_PAGE_AREA_START + idx * PAGE_SIZE;
+    if (!reserve && !heap_map_pages(va, count * PAGE_SIZE)) {
+        return false;
+    }
+    for (size_t i = idx; i < idx + count; i++) {
+        bit_set(area_used, i);
+        if (reserve) {
+            bit_set(area_reserved, i);
+        }
+    }
+    stats.area_pages += count;
+    return true;
+}
+
+static void* area_alloc(size_t count, size_t align_pages, bool reserve = false) {
+    size_t idx = area_find(count, align_pages);
+    if (idx == AREA_PAGES || !area_commit(idx, count, reserve)) {
+        return NULL;
+    }
+    bit_set(area_last, idx + count - 1);
+    area_hint = idx + count;
+    return (void*)(KERNEL_PAGE_AREA_START + idx * PAGE_SIZE);
+}
+
+static void area_free(void* ptr) {
+    size_t idx = ((uintptr_t)ptr - KERNEL_PAGE_AREA_START) / PAGE_SIZE;
+    area_release(idx, area_run_length(idx));
+}
+
+static size_t area_size(void* ptr) {
+    size_t idx = ((uintptr_t)ptr - KERNEL_PAGE_AREA_START) / PAGE_SIZE;
+    return area_run_length(idx) * PAGE_SIZE;
+}
+
+// Resize a page-area allocation in place: map the following pages if they are free (or
+// reserve them, for a kreserve_pages allocation), or unmap the tail on shrink.
+static int area_resize(void* ptr, size_t size) {
+    size_t idx = ((uintptr_t)ptr - KERNEL_PAGE_AREA_START) / PAGE_SIZE;
+    size_t count = area_run_length(idx);
+    size_t new_count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    if (new_count > count) {
+        size_t extra = new_count - count;
+        if (idx + new_count > AREA_PAGES) {
+            return 0;
+        }
+        for (size_t i = idx + count; i < idx + new_count; i++) {
+            if (bit_test(area_used, i)) {
+                return 0;
+            }
+        }
+        if (!area_commit(idx + count, extra, bit_test(area_reserved, idx))) {
+            return 0;
+        }
+        bit_clear(area_last, idx + count - 1);
+        bit_set(area_last, idx + new_count - 1);
+    } else if (new_count < count) {
+        bit_clear(area_last, idx + count - 1);
+        area_release(idx + new_count, count - new_count);
+        bit_set(area_last, idx + new_count - 1);
+    }
+    return 1;
+}
+
+// Usable size of a live allocation: its page run, slab class or block payload.
+static size_t usable_size(void* ptr) {
+    if (in_page_area((uintptr_t)ptr)) {
+        return area_size(ptr);
+    }
+    slab_t* slab = slab_of(ptr);
+    return slab ? slab_class_sizes[slab->class_idx] : block_size(ptr);
+}
+
+static void* heap_alloc(size_t size) {
+    if (size <= SLAB_MAX_SIZE) {
+        return slab_alloc(size);
+    }
+    if (size >= KERNEL_HEAP_PAGE_THRESHOLD) {
+        return area_alloc((size + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+    }
+    return block_alloc(size, 16);
+}
+
+static void stats_add_in_use(size_t bytes) {
+    stats.bytes_in_use += bytes;
+    if (stats.bytes_in_use > stats.peak_in_use) {
+        stats.peak_in_use = stats.bytes_in_use;
+    }
+}
+
+static void stats_record_alloc(size_t size, void* ptr) {
+    if (!ptr) {
+        stats.failed_allocs++;
+        return;
+    }
+    size_t bucket = size <= 16 ? 0 : (32 - __builtin_clz((uint32_t)size - 1)) - 4;
+    if (bucket >= HEAP_HIST_BUCKETS) {
+        bucket = HEAP_HIST_BUCKETS - 1;
+    }
+    stats.size_histogram[bucket]++;
+    stats.alloc_count++;
+    stats_add_in_use(usable_size(ptr));
+}
+
+// Allocate memory from the heap
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (!heap_ready) {
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Heap is not initialized!\n");
+        return NULL;
+    }
+
+    void* ptr = heap_alloc(size);
+    stats_record_alloc(size, ptr);
+    return ptr;
+}
+
+void* kmalloc_aligned(size_t size, size_t align) {
+    if (align <= 16) {
+        return kmalloc(size);
+    }
+    if (size == 0 || (align & (align - 1)) != 0) {
+        return NULL;
+    }
+    if (!heap_ready) {
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Heap is not initialized!\n");
+        return NULL;
+    }
+
+    // Large requests come page-aligned from the page area; smaller ones are carved from a
+    // block, with the misaligned prefix going back to the free lists rather than wasted.
+    void* ptr;
+    if (size >= KERNEL_HEAP_PAGE_THRESHOLD) {
+        size_t align_pages = align > PAGE_SIZE ? align / PAGE_SIZE : 1;
+        ptr = area_alloc((size + PAGE_SIZE - 1) / PAGE_SIZE, align_pages);
+    } else {
+        ptr = block_alloc(size, align);
+    }
+    stats_record_alloc(size, ptr);
+    return ptr;
+}
+
+void* kmalloc_pages(size_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+    if (!heap_ready) {
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Heap is not initialized!\n");
+        return NULL;
+    }
+    void* ptr = area_alloc(count, 1);
+    stats_record_alloc(count * PAGE_SIZE, ptr);
+    return ptr;
+}
+
+void* kreserve_pages(size_t count) {
+    if (count == 0) {
+        return NULL;
+    }
+    if (!heap_ready) {
+        KTRACE(HEAP, ERROR, "[HEAP] Error: Heap is not initialized!\n");
+        return NULL;
+    }
+    void* ptr = area_alloc(count, 1, true);
+    stats_record_alloc(count * PAGE_SIZE, ptr);
+    return ptr;
+}
+
+// Free allocated memory
+void kfree(void* ptr) {
+    if (!ptr) return;
+
+    stats.free_count++;
+    if (in_page_area((uintptr_t)ptr)) {
+        stats.bytes_in_use -= area_size(ptr);
+        area_free(ptr);
+        return;
+    }
+
+    slab_t* slab = slab_of(ptr);
+    if (slab) {
+        stats.bytes_in_use -= slab_class_sizes[slab->class_idx];
+        slab_free(slab, ptr);
+        return;
+    }
+
+    stats.bytes_in_use -= block_size(ptr);
+    block_free(ptr);
 }
 
 // Reallocate memory from the heap
@@ -104,18 +816,105 @@ void* krealloc(void* ptr, size_t size) {
         return kmalloc(size);
     }
 
-    heap_block_t* block = (heap_block_t*)((uintptr_t)ptr - sizeof(heap_block_t));
-    if (block->size >= size) {
-        return ptr; // The current block is already large enough
+    size_t old_size;
+    bool paged = in_page_area((uintptr_t)ptr);
+    slab_t* slab = paged ? NULL : slab_of(ptr);
+    if (paged) {
+        old_size = area_size(ptr);
+        if (old_size >= size) {
+            area_resize(ptr, size); // Unmaps whole pages past the new end
+            stats.bytes_in_use -= old_size - area_size(ptr);
+            return ptr;
+        }
+    } else if (slab) {
+        old_size = slab_class_sizes[slab->class_idx];
+        if (old_size >= size) {
+            return ptr; // The slab object is already large enough
+        }
+    } else {
+        old_size = block_size(ptr);
+        if (old_size >= size) {
+            // Shrink in place; the backend only splits if the tail is worth a block.
+            block_resize(ptr, size);
+            stats.bytes_in_use -= old_size - block_size(ptr);
+            return ptr;
+        }
+    }
+
+    // Grow geometrically so a sequence of small appends costs amortized O(1).
+    size_t target = old_size + old_size / 2;
+    if (target < size) {
+        target = size;
+    }
+
+    if (paged && (area_resize(ptr, target) || area_resize(ptr, size))) {
+        stats_add_in_use(area_size(ptr) - old_size);
+        return ptr;
+    }
+    if (!paged && !slab && (block_resize(ptr, target) || block_resize(ptr, size))) {
+        stats_add_in_use(block_size(ptr) - old_size);
+        return ptr;
     }
 
-    void* new_ptr = kmalloc(size);
+    void* new_ptr = heap_alloc(target);
+    if (!new_ptr && target != size) {
+        new_ptr = heap_alloc(size);
+    }
+    stats_record_alloc(size, new_ptr);
     if (!new_ptr) {
         return NULL; // Allocation failed
     }
 
-    memcpy(new_ptr, ptr, block->size); // Copy old data to new block
+    memcpy(new_ptr, ptr, old_size); // Copy old data to new block
     kfree(ptr); // Free the old block
 
     return new_ptr;
-}
\ No newline at end of file
+}
+
+#if HEAP_USE_TLSF
+static void stats_walker(void* ptr, size_t size, int used, void* user) {
+    (void)ptr;
+    heap_stats_t* out = (heap_stats_t*)user;
+    if (used) {
+        out->used_blocks++;
+    } else {
+        out->free_blocks++;
+        out->free_bytes += size;
+        if (size > out->largest_free) {
+            out->largest_free = size;
+        }
+    }
+}
+#endif
+
+void heap_get_stats(heap_stats_t* out) {
+    *out = stats;
+    out->heap_size = heap_end - KERNEL_HEAP_START;
+    out->free_bytes = 0;
+    out->largest_free = 0;
+    out->free_blocks = 0;
+    out->used_blocks = 0;
+
+    if (heap_ready) {
+#if HEAP_USE_TLSF
+        tlsf_walk(stats_walker, out);
+#else
+        for (heap_block_t* block = free_list; block; block = block->next) {
+            if (!block->free) {
+                out->used_blocks++;
+                continue;
+            }
+            out->free_blocks++;
+            out->free_bytes += block->size;
+            if (block->size > out->largest_free) {
+                out->largest_free = block->size;
+            }
+        }
+#endif
+    }
+
+    // Block sizes are multiples of 16; dividing first keeps the product in 32 bits.
+    out->fragmentation_pct = out->free_bytes
+        ? 100 - (uint32_t)((out->largest_free / 16) * 100 / (out->free_bytes / 16))
+        : 0;
+}
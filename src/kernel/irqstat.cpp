@@ -0,0 +1,67 @@
+#include <kernel/irqstat.h>
+#include <string.h>
+
+#if IRQ_STATS
+static irqstat_t stats[IRQSTAT_VECTORS];
+
+void irqstat_record(uint32_t vector, uint64_t start)
+{
+    if (vector >= IRQSTAT_VECTORS) {
+        return;
+    }
+    uint64_t elapsed = rdtsc() - start;
+    uint32_t cycles = elapsed > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)elapsed;
+
+    irqstat_t* stat = &stats[vector];
+    stat->count++;
+    stat->cycles_total += cycles;
+    if (cycles > stat->cycles_max) {
+        stat->cycles_max = cycles;
+    }
+    stat->hist[31 - __builtin_clz(cycles | 1)]++;
+}
+
+bool irqstat_snapshot(uint32_t vector, irqstat_t* out)
+{
+    if (vector >= IRQSTAT_VECTORS) {
+        return false;
+    }
+    uint32_t flags = irq_save();
+    *out = stats[vector];
+    irq_restore(flags);
+    return true;
+}
+
+void irqstat_reset()
+{
+    uint32_t flags = irq_save();
+    memset(stats, 0, sizeof(stats));
+    irq_restore(flags);
+}
+#else
+bool irqstat_snapshot(uint32_t vector, irqstat_t* out)
+{
+    (void)vector;
+    (void)out;
+    return false;
+}
+
+void irqstat_reset()
+{
+}
+#endif
+
+uint32_t irqstat_average(const irqstat_t* stat)
+{
+    uint64_t total = stat->cycles_total;
+    uint32_t count = stat->count;
+    // Scale both down until the total fits 32 bits; the ratio barely moves.
+    while ((total >> 32) && count > 1) {
+        total >>= 1;
+        count >>= 1;
+    }
+    if (total >> 32) {
+        return 0xFFFFFFFFu;
+    }
+    return count ? (uint32_t)total / count : 0;
+}
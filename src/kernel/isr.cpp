@@ -1,4 +1,6 @@
 #include <kernel/isr.h>
+#include <kernel/apic.h>
+#include <kernel/irqstat.h>
 #include <kernel/pic.h>
 #include <stdio.h>
 #include <kernel/port_io.h>
@@ -8,24 +10,49 @@
 // Array of function pointers to handle interrupts
 static isr_t interrupt_handlers[ISR_COUNT];
 
+// The handler irq_common_stub calls for each vector, straight from this table; NULL for
+// none. With IRQ_STATS the stub passes it to irq_timed_call instead of calling it.
+extern "C" isr_t irq_dispatch_table[ISR_COUNT];
+isr_t irq_dispatch_table[ISR_COUNT];
+
+static void pic_eoi(uint32_t vector)
+{
+    pic_send_eoi(vector - 32);
+}
+
+// Called by irq_common_stub after the handler for vectors 32-47.
+extern "C" irq_eoi_t irq_eoi;
+irq_eoi_t irq_eoi = pic_eoi;
+
 // Registers a custom ISR handler for a given interrupt
 void register_interrupt_handler(uint8_t n, isr_t handler)
 {
     interrupt_handlers[n] = handler;
+    irq_dispatch_table[n] = handler;
+}
+
+void irq_set_eoi(irq_eoi_t eoi)
+{
+    irq_eoi = eoi;
 }
 
 // ISR Handler (for CPU exceptions)
 extern "C" void isr_handler(registers_t *regs)
 {
-    // Print the interrupt code (exception number)
-    printf("ISR Exception: Interrupt %d, Error Code: %d\n", regs->int_no, regs->err_code);
-
-    // Handle critical exceptions like page faults (Interrupt 14)
+    // Handle critical exceptions like page faults (Interrupt 14). A handler that returns
+    // has resolved the exception (e.g. a demand-zero or copy-on-write fault), so the
+    // faulting instruction is simply retried; handlers halt themselves otherwise.
     if(interrupt_handlers[regs->int_no]) {
+        uint64_t start = irqstat_begin();
         isr_t handler = interrupt_handlers[regs->int_no];
         handler(regs);
+        irqstat_record(regs->int_no, start);
+        return;
     }
 
+    // Print the interrupt code (exception number)
+    printf("ISR Exception: Interrupt %d, Error Code: %d\n", regs->int_no, regs->err_code);
+
     // Halt if it's a critical CPU exception
     if (regs->int_no < 32)
     {
@@ -35,26 +62,24 @@ extern "C" void isr_handler(registers_t *regs)
     }
 }
 
-// IRQ Handler (for hardware interrupts)
-extern "C" void irq_handler(registers_t *regs)
+// With IRQ_STATS, irq_common_stub calls the vector's handler through here so it is
+// timed. The stub sends the EOI (end of interrupt) afterwards.
+extern "C" void irq_timed_call(isr_t handler, registers_t *regs)
 {
-    // Send an EOI (end of interrupt) signal to the PICs
-    uint32_t irq_nb = regs->int_no - 32;
+    uint64_t start = irqstat_begin();
+    handler(regs);
+    irqstat_record(regs->int_no, start);
+}
 
-    if (regs->int_no >= 40)
-    {
-        // Send reset signal to slave PIC
-        outb(0xA0, 0x20);
-    }
-    if (regs->int_no >= 32)
+// Unmask an ISA IRQ at the controller in charge
+void irq_unmask(uint8_t irq)
+{
+    if (apic_enabled())
     {
-        // Send reset signal to master PIC
-        outb(0x20, 0x20);
+        apic_unmask_irq(irq);
     }
-
-    if (interrupt_handlers[regs->int_no])
+    else
     {
-        isr_t handler = interrupt_handlers[regs->int_no];
-        handler(regs);
+        pic_unmask_irq(irq);
     }
 }
@@ -2,292 +2,292 @@
 .global isr_common_stub
 .global irq_common_stub
 .extern isr_handler
-.extern irq_handler
+.extern irq_dispatch_table
+.extern irq_eoi
+.extern irq_timed_call
+
+# The Makefile passes IRQ_STATS with --defsym; default to on, like irqstat.h.
+.ifndef IRQ_STATS
+.set IRQ_STATS, 1
+.endif
 
 
 .section .data
 debug_fmt:
     .asciz "Debug: interrupt number %x\n"
 
+.section .text
+
+# Stack layout after the common stubs push ds (this is registers_t)
+.set REGS_INT_NO, 36
+.set REGS_CS, 48
+
+# Interrupt gates already clear IF on entry and iret restores the interrupted EFLAGS, so
+# the stubs neither cli nor sti. The data segments only need reloading when the
+# interrupt arrived from ring 3; in ring 0 they already hold the kernel selector.
+
 # Common ISR Stub
 isr_common_stub:
-    cli
     pusha                   # Push all registers (32 bytes)
-    movw %ds, %ax
+    movl %ds, %eax
     pushl %eax             # Save ds (4 bytes)
 
+    testl $3, REGS_CS(%esp)
+    jz 1f
     # Load kernel data segment
     movw $0x10, %ax
     movw %ax, %ds
     movw %ax, %es
     movw %ax, %fs
     movw %ax, %gs
-
+1:
     # Push pointer to registers_t structure
     pushl %esp            # Push current stack pointer as argument to handler
-    
-    call isr_handler      # Call IRQ handler
-    
-    addl $4, %esp        # Remove registers_t pointer argument
 
-    # Restore data segments
-    popl %eax            # Restore original data segment
-    movw %ax, %ds
-    movw %ax, %es
-    movw %ax, %fs
-    movw %ax, %gs
+    call isr_handler      # Call exception handler
 
-    popa                 # Restore all registers
-    addl $8, %esp       # Clean up error code and interrupt number
-    sti                 # Re-enable interrupts
-    iret                     # Return from interrupt
+    addl $4, %esp        # Remove registers_t pointer argument
+    jmp interrupt_return
 
+# Common IRQ stub: call the vector's handler from irq_dispatch_table, if any, then
+# acknowledge ISA lines (vectors 32-47) through irq_eoi. With IRQ_STATS the call goes
+# through irq_timed_call, which is handed the handler loaded here.
 irq_common_stub:
-    cli
     pusha                   # Push all registers (32 bytes)
-    movw %ds, %ax
+    movl %ds, %eax
     pushl %eax             # Save ds (4 bytes)
 
+    testl $3, REGS_CS(%esp)
+    jz 1f
     # Load kernel data segment
     movw $0x10, %ax
     movw %ax, %ds
     movw %ax, %es
     movw %ax, %fs
     movw %ax, %gs
-
-    # Push pointer to registers_t structure
-    pushl %esp            # Push current stack pointer as argument to handler
-    
-    call irq_handler      # Call IRQ handler
-    
-    addl $4, %esp        # Remove registers_t pointer argument
-
+1:
+    movl REGS_INT_NO(%esp), %eax
+    movl irq_dispatch_table(,%eax,4), %ecx
+    testl %ecx, %ecx      # No handler registered
+    jz 4f
+.if IRQ_STATS
+    pushl %esp            # registers_t* argument
+    pushl %ecx            # Handler
+    call irq_timed_call
+    addl $8, %esp
+.else
+    pushl %esp            # registers_t* argument
+    call *%ecx
+    addl $4, %esp
+.endif
+4:
+
+    movl REGS_INT_NO(%esp), %eax
+    cmpl $48, %eax        # Software-raised vectors have nothing to acknowledge
+    jae interrupt_return
+    pushl %eax
+    call *irq_eoi
+    addl $4, %esp
+
+interrupt_return:
+    testl $3, REGS_CS(%esp)
+    jz 2f
     # Restore data segments
     popl %eax            # Restore original data segment
     movw %ax, %ds
     movw %ax, %es
     movw %ax, %fs
     movw %ax, %gs
-
+    jmp 3f
+2:
+    addl $4, %esp        # Saved ds is still loaded
+3:
     popa                 # Restore all registers
     addl $8, %esp       # Clean up error code and interrupt number
-    sti                 # Re-enable interrupts
-    iret                # Return from interrupt
+    iret                     # Return from interrupt
 
 # Exception Handlers (ISRs)
 .global isr0
 isr0:
-    cli
     pushl $0                # Push dummy error code
     pushl $0                # Push interrupt number
     jmp isr_common_stub
 
 .global isr1
 isr1:
-    cli
     pushl $0                # Push dummy error code
     pushl $1                # Push interrupt number
     jmp isr_common_stub
 
 .global isr2
 isr2:
-    cli
     pushl $0                # Push dummy error code
     pushl $2                # Push interrupt number
     jmp isr_common_stub
 
 .global isr3
 isr3:
-    cli
     pushl $0                # Push dummy error code
     pushl $3                # Push interrupt number
     jmp isr_common_stub
 
 .global isr4
 isr4:
-    cli
     pushl $0                # Push dummy error code
     pushl $4                # Push interrupt number
     jmp isr_common_stub
 
 .global isr5
 isr5:
-    cli
     pushl $0                # Push dummy error code
     pushl $5                # Push interrupt number
     jmp isr_common_stub
 
 .global isr6
 isr6:
-    cli
     pushl $0                # Push dummy error code
     pushl $6                # Push interrupt number
     jmp isr_common_stub
 
 .global isr7
 isr7:
-    cli
     pushl $0                # Push dummy error code
     pushl $7                # Push interrupt number
     jmp isr_common_stub
 
 .global isr8
 isr8:
-    cli
     pushl $8                # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr9
 isr9:
-    cli
     pushl $0                # Push dummy error code
     pushl $9                # Push interrupt number
     jmp isr_common_stub
 
 .global isr10
 isr10:
-    cli
     pushl $10               # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr11
 isr11:
-    cli
     pushl $11               # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr12
 isr12:
-    cli
     pushl $12               # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr13
 isr13:
-    cli
     pushl $13               # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr14
 isr14:
-    cli
     pushl $14 # the CPU already pushes an error code
     jmp isr_common_stub
 
 
 .global isr15
 isr15:
-    cli
     pushl $0                # Push dummy error code
     pushl $15               # Push interrupt number
     jmp isr_common_stub
 
 .global isr16
 isr16:
-    cli
     pushl $0                # Push dummy error code
     pushl $16               # Push interrupt number
     jmp isr_common_stub
 
 .global isr17
 isr17:
-    cli
     pushl $17               # Push interrupt number
     jmp isr_common_stub
 
 .global isr18
 isr18:
-    cli
     pushl $0                # Push dummy error code
     pushl $18               # Push interrupt number
     jmp isr_common_stub
 
 .global isr19
 isr19:
-    cli
     pushl $0                # Push dummy error code
     pushl $19               # Push interrupt number
     jmp isr_common_stub
 
 .global isr20
 isr20:
-    cli
     pushl $0                # Push dummy error code
     pushl $20               # Push interrupt number
     jmp isr_common_stub
 
 .global isr21
 isr21:
-    cli
     pushl $0                # Push dummy error code
     pushl $21               # Push interrupt number
     jmp isr_common_stub
 
 .global isr22
 isr22:
-    cli
     pushl $0                # Push dummy error code
     pushl $22               # Push interrupt number
     jmp isr_common_stub
 
 .global isr23
 isr23:
-    cli
     pushl $0                # Push dummy error code
     pushl $23               # Push interrupt number
     jmp isr_common_stub
 
 .global isr24
 isr24:
-    cli
     pushl $0                # Push dummy error code
     pushl $24               # Push interrupt number
     jmp isr_common_stub
 
 .global isr25
 isr25:
-    cli
     pushl $0                # Push dummy error code
     pushl $25               # Push interrupt number
     jmp isr_common_stub
 
 .global isr26
 isr26:
-    cli
     pushl $0                # Push dummy error code
     pushl $26               # Push interrupt number
     jmp isr_common_stub
 
 .global isr27
 isr27:
-    cli
     pushl $0                # Push dummy error code
     pushl $27               # Push interrupt number
     jmp isr_common_stub
 
 .global isr28
 isr28:
-    cli
     pushl $0                # Push dummy error code
     pushl $28               # Push interrupt number
     jmp isr_common_stub
 
 .global isr29
 isr29:
-    cli
     pushl $0                # Push dummy error code
     pushl $29               # Push interrupt number
     jmp isr_common_stub
 
 .global isr30
 isr30:
-    cli
     pushl $30               # Interrupt number (CPU already pushes error code)
     jmp isr_common_stub
 
 .global isr31
 isr31:
-    cli
     pushl $0                # Push dummy error code
     pushl $31               # Push interrupt number
     jmp isr_common_stub
@@ -295,116 +295,105 @@ isr31:
 # IRQ Handlers (IRQs 0-15)
 .global irq0
 irq0:
-    cli
     pushl $0                # Push dummy error code
     pushl $32               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq1
 irq1:
-    cli
     pushl $0                # Push dummy error code
     pushl $33               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq2
 irq2:
-    cli
     pushl $0                # Push dummy error code
     pushl $34               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq3
 irq3:
-    cli
     pushl $0                # Push dummy error code
     pushl $35               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq4
 irq4:
-    cli
     pushl $0                # Push dummy error code
     pushl $36               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq5
 irq5:
-    cli
     pushl $0                # Push dummy error code
     pushl $37               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq6
 irq6:
-    cli
     pushl $0                # Push dummy error code
     pushl $38               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq7
 irq7:
-    cli
     pushl $0                # Push dummy error code
     pushl $39               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq8
 irq8:
-    cli
     pushl $0                # Push dummy error code
     pushl $40               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq9
 irq9:
-    cli
     pushl $0                # Push dummy error code
     pushl $41               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq10
 irq10:
-    cli
     pushl $0                # Push dummy error code
     pushl $42               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq11
 irq11:
-    cli
     pushl $0                # Push dummy error code
     pushl $43               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq12
 irq12:
-    cli
     pushl $0                # Push dummy error code
     pushl $44               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq13
 irq13:
-    cli
     pushl $0                # Push dummy error code
     pushl $45               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq14
 irq14:
-    cli
     pushl $0                # Push dummy error code
     pushl $46               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
 .global irq15
 irq15:
-    cli
     pushl $0                # Push dummy error code
     pushl $47               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
+# Local APIC spurious interrupts: no handler and no EOI.
+.global lapic_spurious
+lapic_spurious:
+    iret
+
 .section .data
 .global isr_stub_table
 isr_stub_table:
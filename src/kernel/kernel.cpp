@@ -7,10 +7,12 @@
 #include "kernel/paging.h"
 #include "kernel/heap.h"
 #include "kernel/pic.h"
+#include "kernel/apic.h"
 #include "kernel/keyboard.h"
 #include "kernel/gdt.h"
 #include "kernel/timer.h"
 #include "kernel/shell.h"
+#include "kernel/workqueue.h"
 #include "kernel/ramfs.h"
 #include "kernel/tests/memtest.h"
 #include "kernel/tests/pagetest.h"
@@ -47,6 +49,9 @@ extern "C"
 		// Initialize the IDT
 		init_idt();
 
+		// Track physical frames (the heap and page tables are built from them)
+		PhysicalMemoryManager::initialize(multiboot_info);
+
 		// Initialize virtual memory management
 		vmm_init();
 		vmm_enable();
@@ -54,6 +59,9 @@ extern "C"
 		// Set up heap
 		init_heap();
 
+		// Route IRQs through the APIC when there is one (its registers need paging)
+		apic_init();
+
 		// Initialize the RAMFS.
 		fs_init();
 
@@ -82,9 +90,25 @@ extern "C"
 
 		__asm__ volatile("sti");
 
+		// Idle loop: run work deferred by IRQ handlers, then top up the pre-zeroed
+		// frame pool a frame at a time, and halt until the next interrupt once both
+		// are done. The final check runs with interrupts off and 'sti; hlt' cannot be
+		// split, so work queued in between still wakes the loop.
 		while (1)
 		{
-			__asm__ volatile("hlt");
+			if (workqueue_run_all() || PhysicalMemoryManager::refill_zero_pool(1))
+			{
+				continue;
+			}
+			__asm__ volatile("cli");
+			if (workqueue_pending())
+			{
+				__asm__ volatile("sti");
+			}
+			else
+			{
+				__asm__ volatile("sti; hlt");
+			}
 		}
 	}
 
@@ -5,6 +5,7 @@
 #include "kernel/keyboard.h" // Include the new header file
 #include "stdio.h"           // Include the new header file
 #include "kernel/shell.h"
+#include "kernel/workqueue.h"
 
 
 
@@ -124,10 +125,19 @@ keyboard_event read_keyboard() {
     return event;
 }
 
+static workqueue_t keyboard_wq;
+
+// Runs from the idle loop, so a long shell command no longer holds off other IRQs.
+static void keyboard_work(const void* data)
+{
+    shell_handle_key(*(const keyboard_event*)data);
+}
+
 void keyboard_callback(registers_t *regs)
 {
+    // Read the scancode now (the controller needs it drained); the shell sees it later.
     keyboard_event event = read_keyboard();
-    shell_handle_key(event);
+    work_queue(&keyboard_wq, keyboard_work, &event, sizeof(event));
 }
 
 void wait_for_input_clear()
@@ -186,8 +196,9 @@ void keyboard_install()
 {
     printf("[KB] Enabling keyboard...");
     keyboard_enable();
+    workqueue_init(&keyboard_wq, "keyboard");
     register_interrupt_handler(33, keyboard_callback);
-    pic_unmask_irq(1);
+    irq_unmask(1);
 }
 
 void keyboard_check_status()
@@ -0,0 +1,165 @@
+#include <kernel/kmem_cache.h>
+#include <kernel/heap.h>
+#include <kernel/memory.h>  // For PAGE_SIZE
+#include <kernel/trace.h>
+#include <string.h>
+
+// Slab header, stored at the start of every page-aligned cache slab. Full slabs are
+// on no list; they rejoin the partial list when an object comes back.
+struct kmem_slab {
+    kmem_slab_t* next;
+    kmem_slab_t* prev;
+    kmem_cache_t* cache;
+    void* free_objects;          // Singly linked through the first word of each free object
+    uint16_t in_use;
+};
+
+static kmem_cache_t* cache_list = NULL;
+
+static inline size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+static void slab_push(kmem_slab_t** head, kmem_slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_unlink(kmem_slab_t** head, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = slab->prev = NULL;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, uint32_t flags, kmem_ctor_t ctor) {
+    size_t align = (flags & KMEM_CACHE_ALIGN) ? KMEM_CACHE_LINE : sizeof(void*);
+    size_t obj_size = align_up(size < sizeof(void*) ? sizeof(void*) : size, align);
+    size_t first = align_up(sizeof(kmem_slab_t), align);
+    if (first + obj_size > PAGE_SIZE) {
+        KTRACE(HEAP, ERROR, "[KMEM] Cache '%s': %d-byte objects do not fit a slab\n", name, size);
+        return NULL;
+    }
+
+    kmem_cache_t* cache = (kmem_cache_t*)kmalloc(sizeof(kmem_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->obj_size = obj_size;
+    cache->first_offset = first;
+    cache->per_slab = (PAGE_SIZE - first) / obj_size;
+    cache->ctor = ctor;
+
+    cache->next = cache_list;
+    cache_list = cache;
+    KTRACE(HEAP, DEBUG, "[KMEM] Cache '%s': %d-byte objects, %d per slab\n",
+           name, obj_size, cache->per_slab);
+    return cache;
+}
+
+static kmem_slab_t* slab_create(kmem_cache_t* cache) {
+    kmem_slab_t* slab = (kmem_slab_t*)kmalloc_aligned(PAGE_SIZE, PAGE_SIZE);
+    if (!slab) {
+        return NULL;
+    }
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->next = slab->prev = NULL;
+
+    uint8_t* base = (uint8_t*)slab + cache->first_offset;
+    slab->free_objects = NULL;
+    for (size_t i = cache->per_slab; i > 0; i--) {
+        void** node = (void**)(base + (i - 1) * cache->obj_size);
+        *node = slab->free_objects;
+        slab->free_objects = node;
+    }
+    cache->slab_count++;
+    return slab;
+}
+
+static void slab_destroy(kmem_cache_t* cache, kmem_slab_t* slab) {
+    cache->slab_count--;
+    kfree(slab);
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    kmem_slab_t* slab = cache->partial;
+    if (!slab) {
+        if (cache->empty) {
+            slab = cache->empty;
+            cache->empty = NULL;
+        } else {
+            slab = slab_create(cache);
+            if (!slab) {
+                return NULL;
+            }
+        }
+        slab_push(&cache->partial, slab);
+    }
+
+    void** obj = (void**)slab->free_objects;
+    slab->free_objects = *obj;
+    slab->in_use++;
+    cache->objs_in_use++;
+    if (!slab->free_objects) {
+        slab_unlink(&cache->partial, slab);
+    }
+
+    if (cache->ctor) {
+        cache->ctor(obj);
+    }
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!obj) {
+        return;
+    }
+    kmem_slab_t* slab = (kmem_slab_t*)((uintptr_t)obj & ~((uintptr_t)PAGE_SIZE - 1));
+    if (slab->cache != cache) {
+        KTRACE(HEAP, ERROR, "[KMEM] Object %p freed to the wrong cache '%s'\n", obj, cache->name);
+        return;
+    }
+
+    bool was_full = (slab->free_objects == NULL);
+    *(void**)obj = slab->free_objects;
+    slab->free_objects = obj;
+    slab->in_use--;
+    cache->objs_in_use--;
+
+    if (was_full) {
+        slab_push(&cache->partial, slab);
+    }
+
+    // Keep one empty slab cached; give the rest back to the heap.
+    if (slab->in_use == 0) {
+        slab_unlink(&cache->partial, slab);
+        if (!cache->empty) {
+            cache->empty = slab;
+        } else {
+            slab_destroy(cache, slab);
+        }
+    }
+}
+
+void kmem_cache_shrink(kmem_cache_t* cache) {
+    if (cache->empty) {
+        slab_destroy(cache, cache->empty);
+        cache->empty = NULL;
+    }
+}
+
+kmem_cache_t* kmem_cache_list() {
+    return cache_list;
+}
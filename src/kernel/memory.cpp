@@ -1,84 +1,647 @@
 #include <stdint.h>
 #include <string.h> // for memset
 #include "kernel/memory.h"
+#include "kernel/paging.h"
+#include "kernel/cpu.h"
 #include "kernel/multiboot.h" // for multiboot_info_t
+#include "kernel/trace.h"
 
+extern "C" uint32_t kernel_start;
 extern "C" uint32_t kernel_end;
 
-uint32_t* PhysicalMemoryManager::bitmap       = nullptr;
-uint32_t  PhysicalMemoryManager::total_frames = 0;
-uint32_t  PhysicalMemoryManager::used_frames  = 0;
+SummaryBitmap PhysicalMemoryManager::frames;
+SummaryBitmap PhysicalMemoryManager::free_area[PMM_MAX_ORDER + 1];
+uint8_t* PhysicalMemoryManager::share_counts;
+uint32_t      PhysicalMemoryManager::total_frames = 0;
+uint32_t      PhysicalMemoryManager::used_frames  = 0;
+pmm_zone_stats_t PhysicalMemoryManager::zones[ZONE_COUNT];
+uint32_t      PhysicalMemoryManager::zero_pool[PMM_ZERO_POOL_SIZE];
+uint32_t      PhysicalMemoryManager::zero_pool_count  = 0;
+uint32_t      PhysicalMemoryManager::zero_pool_hits   = 0;
+uint32_t      PhysicalMemoryManager::zero_pool_misses = 0;
+
+// First frame of each zone, plus the end of the last one.
+static const uint32_t zone_start[ZONE_COUNT + 1] = {
+    0,                  // ZONE_DMA
+    0x01000000 >> 12,   // ZONE_NORMAL: 16 MiB
+    0x00100000,         // ZONE_HIGH: 4 GiB, in frames
+    UINT32_MAX,
+};
+
+static inline pmm_zone zone_of(uint32_t frame) {
+    return frame < zone_start[ZONE_NORMAL] ? ZONE_DMA
+         : frame < zone_start[ZONE_HIGH]   ? ZONE_NORMAL
+                                           : ZONE_HIGH;
+}
 
 /* Helper: Align 'val' up to 'align' boundary */
 static inline uint32_t align_up(uint32_t val, uint32_t align) {
     return (val + (align - 1)) & ~(align - 1);
 }
 
+// Frame range [*first, *end) of a memory map entry, clipped to PMM_PHYS_LIMIT. Available regions are rounded inwards to whole frames, everything
+// else outwards, so a partially reserved frame is never handed out.
+static bool region_frames(const multiboot_memory_map_t* entry, uint32_t* first, uint32_t* end)
+{
+    const uint64_t limit = PMM_PHYS_LIMIT;
+    uint64_t start = entry->addr;
+    uint64_t stop = entry->addr + entry->len;
+    if (start >= limit || entry->len == 0) {
+        return false;
+    }
+    if (stop > limit) {
+        stop = limit;
+    }
+    if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+        *first = (uint32_t)((start + PAGE_SIZE - 1) >> 12);
+        *end = (uint32_t)(stop >> 12);
+    } else {
+        *first = (uint32_t)(start >> 12);
+        *end = (uint32_t)((stop + PAGE_SIZE - 1) >> 12);
+    }
+    return *first < *end;
+}
+
+#define for_each_mmap_entry(entry, mb_info)                                              \
+    for (multiboot_memory_map_t* entry = (multiboot_memory_map_t*)(mb_info)->mmap_addr;  \
+         (uint32_t)entry < (mb_info)->mmap_addr + (mb_info)->mmap_length;               \
+         entry = (multiboot_memory_map_t*)((uint32_t)entry + entry->size + sizeof(entry->size)))
+
+#define PMM_MMAP_MAX   64  // Memory map entries initialize keeps a copy of
+#define PMM_BOOT_HOLD  16  // Frames of multiboot data held back until initialize returns
+
+// initialize works from this copy of the memory map only: the bootloader's map may sit
+// right behind the kernel, where the allocator metadata is about to go.
+static multiboot_memory_map_t mmap_copy[PMM_MMAP_MAX];
+static uint32_t mmap_count;
+
+#define for_each_region(entry) \
+    for (const multiboot_memory_map_t* entry = mmap_copy; entry < mmap_copy + mmap_count; entry++)
+
+// A physical byte range [start, end).
+struct phys_range {
+    uint32_t start;
+    uint32_t end;
+};
+
+// Whether [start, end) lies inside a single available region.
+static bool in_available_region(uint32_t start, uint32_t end)
+{
+    for_each_region(entry) {
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->addr <= start &&
+            entry->addr + entry->len >= end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lowest page-aligned address from 'addr' up where 'size' bytes fit inside available
+// RAM, clear of every range in 'busy' and below the end of the identity map, through
+// which the metadata is reached once paging is on. Returns 0 if there is none.
+static uint32_t place_metadata(uint32_t addr, uint32_t size, const phys_range* busy, uint32_t busy_count)
+{
+    addr = align_up(addr, PAGE_SIZE);
+    for (;;) {
+        uint64_t end = (uint64_t)addr + size;
+        if (end > VMM_IDENTITY_LIMIT) {
+            return 0;
+        }
+
+        bool moved = false;
+        for (uint32_t i = 0; i < busy_count; i++) {
+            if (addr < busy[i].end && end > busy[i].start) {
+                addr = align_up(busy[i].end, PAGE_SIZE);
+                moved = true;
+            }
+        }
+        if (moved) {
+            continue;
+        }
+        if (in_available_region(addr, (uint32_t)end)) {
+            return addr;
+        }
+
+        // Move on to the next available region that starts above 'addr'.
+        uint64_t next = UINT64_MAX;
+        for_each_region(entry) {
+            uint64_t first = ((uint64_t)entry->addr + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && first > addr && first < next) {
+                next = first;
+            }
+        }
+        if (next >= VMM_IDENTITY_LIMIT) {
+            return 0;
+        }
+        addr = (uint32_t)next;
+    }
+}
+
 void PhysicalMemoryManager::initialize(uint32_t multiboot_info_addr)
 {
-    // 1) Interpret multiboot structure
+    // 1) Interpret the multiboot structure and copy the memory map out of it before
+    //    anything is written to memory. Without a memory map, mem_upper (KB above 1MB)
+    //    describes one contiguous region.
     auto mb_info = reinterpret_cast<multiboot_info_t*>(multiboot_info_addr);
+    bool have_mmap = (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) != 0;
 
-    // 2) Determine total memory using mem_upper
-    //    mem_upper is KB above 1MB. So total memory = (mem_upper + 1024) KB
-    //    Convert to bytes, then to page frames
-    uint32_t mem_bytes = (mb_info->mem_upper + 1024) * 1024;
-    total_frames = mem_bytes / PAGE_SIZE;
+    mmap_count = 0;
+    if (have_mmap) {
+        for_each_mmap_entry(entry, mb_info) {
+            if (mmap_count == PMM_MMAP_MAX) {
+                KTRACE(PMM, ERROR, "[PMM] Memory map has over %d entries, ignoring the rest\n", PMM_MMAP_MAX);
+                break;
+            }
+            mmap_copy[mmap_count++] = *entry;
+        }
+    } else {
+        multiboot_memory_map_t* entry = &mmap_copy[mmap_count++];
+        entry->size = sizeof(*entry) - sizeof(entry->size);
+        entry->addr = 0x100000;
+        entry->len = (uint64_t)mb_info->mem_upper * 1024;
+        entry->type = MULTIBOOT_MEMORY_AVAILABLE;
+    }
 
-    used_frames = 0;
+    // The kernel image, and the multiboot data that stays in use until we return.
+    phys_range busy[3] = {
+        { reinterpret_cast<uint32_t>(&kernel_start), reinterpret_cast<uint32_t>(&kernel_end) },
+        { multiboot_info_addr, multiboot_info_addr + sizeof(multiboot_info_t) },
+        { 0, 0 },
+    };
+    if (have_mmap) {
+        busy[2].start = mb_info->mmap_addr;
+        busy[2].end = mb_info->mmap_addr + mb_info->mmap_length;
+    }
 
-    // 3) Compute bitmap size in 32-bit words
-    uint32_t bitmap_size = total_frames / 32;
-    if (total_frames % 32) {
-        bitmap_size++;
+    // 2) Size the frame space to the end of the highest available region.
+    total_frames = 0;
+    for_each_region(entry) {
+        uint32_t first, end;
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && region_frames(entry, &first, &end) &&
+            end > total_frames) {
+            total_frames = end;
+        }
+    }
+
+    // 3) Place the frame bitmap, one free-area bitmap per buddy order and the share
+    //    counts in available RAM above the kernel, clear of the multiboot data. Every
+    //    frame starts out used, with no free blocks.
+    uint32_t words = SummaryBitmap::words_needed(total_frames);
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        words += SummaryBitmap::words_needed(total_frames >> order);
+    }
+    uint32_t metadata_size = words * sizeof(uint32_t) + align_up(total_frames, sizeof(uint32_t));
+    uint32_t metadata = place_metadata(busy[0].end, metadata_size, busy, 3);
+    if (!metadata) {
+        KTRACE(PMM, ERROR, "[PMM] No room for %d bytes of frame metadata, using the end of the kernel\n",
+               metadata_size);
+        metadata = align_up(busy[0].end, PAGE_SIZE);
+    }
+
+    uint32_t* storage = reinterpret_cast<uint32_t*>(metadata);
+    frames.init(storage, total_frames, true);
+    storage += SummaryBitmap::words_needed(total_frames);
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        uint32_t blocks = total_frames >> order;
+        free_area[order].init(storage, blocks, true);
+        storage += SummaryBitmap::words_needed(blocks);
+    }
+    share_counts = reinterpret_cast<uint8_t*>(storage);
+    memset(share_counts, 0, total_frames);
+
+    // 4) Mark available RAM free in the frame bitmap, then take back anything a
+    //    non-available entry overlaps, so reserved and ACPI ranges always win.
+    for_each_region(entry) {
+        uint32_t first, end;
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && region_frames(entry, &first, &end)) {
+            for (uint32_t frame = first; frame < end; frame++) {
+                clear_frame(frame);
+            }
+        }
+    }
+    for_each_region(entry) {
+        uint32_t first, end;
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE && region_frames(entry, &first, &end)) {
+            for (uint32_t frame = first; frame < end && frame < total_frames; frame++) {
+                set_frame(frame);
+            }
+        }
+    }
+
+    // 5) IMPORTANT: Keep the kernel image + the metadata used, and frame 0 so that a
+    //    valid frame is never a null pointer. The multiboot frames are only held back
+    //    for now; they go to the buddy allocator last.
+    set_frame(0);
+    for (uint32_t addr = busy[0].start; addr < busy[0].end; addr += PAGE_SIZE) {
+        set_frame(addr / PAGE_SIZE);
+    }
+    for (uint32_t addr = metadata; addr < metadata + metadata_size; addr += PAGE_SIZE) {
+        set_frame(addr / PAGE_SIZE);
+    }
+    uint32_t held[PMM_BOOT_HOLD];
+    uint32_t held_count = 0;
+    for (uint32_t i = 1; i < 3; i++) {
+        for (uint32_t frame = busy[i].start / PAGE_SIZE;
+             busy[i].end && frame <= (busy[i].end - 1) / PAGE_SIZE && frame < total_frames; frame++) {
+            if (!frames.test(frame)) {
+                set_frame(frame);
+                // Past PMM_BOOT_HOLD frames the rest simply stay reserved.
+                if (held_count < PMM_BOOT_HOLD) {
+                    held[held_count++] = frame;
+                }
+            }
+        }
     }
 
-    // 4) Place the bitmap just after the kernel in memory
-    static uint32_t next_free_physical = reinterpret_cast<uint32_t>(&kernel_end);
-    next_free_physical = align_up(next_free_physical, PAGE_SIZE);
+    // 6) Hand every run of free frames to the buddy allocator.
+    memset(zones, 0, sizeof(zones));
+    used_frames = total_frames;
+    uint32_t run = frames.find_clear_from(0);
+    while (run != UINT32_MAX) {
+        uint32_t run_end = run;
+        while (run_end < total_frames && !frames.test(run_end)) {
+            run_end++;
+        }
+        release_range(run, run_end);
+        run = frames.find_clear_from(run_end);
+    }
+
+    // 7) Nothing reads the multiboot data any more; free the frames it was using.
+    for (uint32_t i = 0; i < held_count; i++) {
+        release_range(held[i], held[i] + 1);
+    }
+    for (int zone = 0; zone < ZONE_COUNT; zone++) {
+        zones[zone].managed_frames = zones[zone].free_frames;
+    }
+
+    KTRACE(PMM, INFO, "[PMM] %d KiB usable, %d frames (%d reserved)%s\n",
+           (total_frames - used_frames) * (PAGE_SIZE / 1024), total_frames, used_frames,
+           have_mmap ? "" : ", no memory map");
+}
+
+void PhysicalMemoryManager::release_range(uint32_t start, uint32_t end)
+{
+    uint32_t frame = start;
+    while (frame < end) {
+        // Largest block that is aligned at 'frame' and still fits before 'end'.
+        uint32_t order = frame ? __builtin_ctz(frame) : PMM_MAX_ORDER;
+        if (order > PMM_MAX_ORDER) {
+            order = PMM_MAX_ORDER;
+        }
+        while (frame + (1u << order) > end) {
+            order--;
+        }
+        put_block(frame, order);  // By frame number: the range may lie above 4 GiB
+        used_frames -= 1u << order;
+        frame += 1u << order;
+    }
+}
 
-    bitmap = reinterpret_cast<uint32_t*>(next_free_physical);
+// A zone this machine has no memory in stands for the next populated one below it.
+pmm_zone PhysicalMemoryManager::populated_zone(pmm_zone zone)
+{
+    while (zone > ZONE_DMA && zones[zone].managed_frames == 0) {
+        zone = (pmm_zone)(zone - 1);
+    }
+    return zone;
+}
 
-    uint32_t bytes_needed = bitmap_size * sizeof(uint32_t);
-    next_free_physical += bytes_needed;
+// Whether a lower zone may lend a block of 2^order frames and stay above its reserve.
+bool PhysicalMemoryManager::can_fall_back(int zone, uint32_t order)
+{
+    return zones[zone].free_frames >= PMM_ZONE_RESERVE + (1u << order);
+}
 
-    // 5) Clear the bitmap (mark all frames as free initially)
-    memset(bitmap, 0, bytes_needed);
+// Take a block of 2^order frames from exactly 'zone', splitting the smallest larger
+// block if need be. Returns its first frame number, or UINT32_MAX.
+uint32_t PhysicalMemoryManager::take_block_in(uint32_t order, int zone)
+{
+    // Smallest order with a free block in the zone; take its lowest block.
+    uint32_t current = order;
+    uint32_t block = UINT32_MAX;
+    for (; current <= PMM_MAX_ORDER; current++) {
+        block = free_area[current].find_clear_from(zone_start[zone] >> current);
+        if (block != UINT32_MAX && (block << current) < zone_start[zone + 1]) {
+            break;
+        }
+        block = UINT32_MAX;
+    }
+    if (block == UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    free_area[current].set(block);
 
-    // 6) IMPORTANT: Mark [0 .. next_free_physical) as used,
-    //    since this area contains the kernel + this bitmap itself.
-    for (uint32_t addr = 0; addr < next_free_physical; addr += PAGE_SIZE) {
-        uint32_t frame_idx = addr / PAGE_SIZE;
-        set_frame(frame_idx);  // mark frame as used
-        used_frames++;
+    // Split down to the requested order, freeing the upper half at each step.
+    while (current > order) {
+        current--;
+        block *= 2;
+        free_area[current].clear(block + 1);
     }
 
-    // (Optionally, if you know other regions are reserved, mark them used too.)
+    uint32_t frame = block << order;
+    frames.set_range(frame, 1u << order);
+    zones[zone].free_frames -= 1u << order;
+    return frame;
 }
 
-void* PhysicalMemoryManager::allocate_frame()
+// Take a block of 2^order frames from 'zone' or, failing that, a lower zone that is
+// above its reserve. Returns its first frame number, or UINT32_MAX; the caller does
+// the used_frames accounting.
+uint32_t PhysicalMemoryManager::take_block(uint32_t order, pmm_zone zone)
 {
-    uint32_t frame = first_free();
+    zone = populated_zone(zone);
+    for (int z = zone; z >= ZONE_DMA; z--) {
+        if (z != zone && !can_fall_back(z, order)) {
+            continue;
+        }
+        uint32_t frame = take_block_in(order, z);
+        if (frame == UINT32_MAX) {
+            continue;
+        }
+        if (z != zone) {
+            zones[z].fallback_allocs++;
+        }
+        return frame;
+    }
+    return UINT32_MAX;
+}
+
+// Return a block to the free areas, merging with its buddy for as long as that is free too.
+void PhysicalMemoryManager::put_block(uint32_t frame, uint32_t order)
+{
+    frames.clear_range(frame, 1u << order);
+    zones[zone_of(frame)].free_frames += 1u << order;
+
+    uint32_t block = frame >> order;
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = block ^ 1;
+        if (buddy >= free_area[order].size() || free_area[order].test(buddy)) {
+            break;
+        }
+        free_area[order].set(buddy);
+        block >>= 1;
+        order++;
+    }
+    free_area[order].clear(block);
+}
+
+// The pointer-based calls hand out 32-bit physical addresses, so they stop short of
+// ZONE_HIGH; only the frame-number calls reach memory above 4 GiB.
+static inline pmm_zone pointer_zone(pmm_zone zone)
+{
+    return zone > ZONE_NORMAL ? ZONE_NORMAL : zone;
+}
+
+void* PhysicalMemoryManager::allocate_frames(uint32_t order, pmm_zone zone)
+{
+    if (order > PMM_MAX_ORDER) {
+        return nullptr;
+    }
+    zone = pointer_zone(zone);
+    uint32_t frame = take_block(order, zone);
     if (frame == UINT32_MAX) {
-        return nullptr; // no free frames available
+        KTRACE(PMM, ERROR, "[PMM] Out of physical frames for order %d in %s!\n", order, zone_name(zone));
+        return nullptr;
     }
-    set_frame(frame);
-    used_frames++;
-    // Return the physical address of this frame
+    used_frames += 1u << order;
+    KTRACE(PMM, DEBUG, "[PMM] Allocated %d frames at 0x%x\n", 1u << order, frame * PAGE_SIZE);
     return reinterpret_cast<void*>(frame * PAGE_SIZE);
 }
 
+void PhysicalMemoryManager::free_frames(void* addr, uint32_t order)
+{
+    uint32_t frame = reinterpret_cast<uint32_t>(addr) / PAGE_SIZE;
+    if (order > PMM_MAX_ORDER || (frame & ((1u << order) - 1)) || frame >= total_frames) {
+        KTRACE(PMM, ERROR, "[PMM] Bad free of 0x%x, order %d\n", reinterpret_cast<uint32_t>(addr), order);
+        return;
+    }
+    put_block(frame, order);
+    used_frames -= 1u << order;
+    KTRACE(PMM, DEBUG, "[PMM] Freed %d frames at 0x%x\n", 1u << order, frame * PAGE_SIZE);
+}
+
+uint32_t PhysicalMemoryManager::allocate_pfns_bulk(uint32_t count, uint32_t* out, pmm_zone zone)
+{
+    // Take the largest blocks that still fit the remaining count, dropping to a smaller
+    // order only once no block of the current one is left. A lower zone is only touched
+    // once the preferred one has no block of any order left, so a large request does
+    // not pull big blocks out of ZONE_DMA while the preferred zone still has small ones.
+    uint32_t got = 0;
+    zone = populated_zone(zone);
+    for (int z = zone; z >= ZONE_DMA && got < count; z--) {
+        uint32_t order = PMM_MAX_ORDER;
+        while (got < count) {
+            while ((1u << order) > count - got) {
+                order--;
+            }
+            uint32_t frame = UINT32_MAX;
+            if (z == zone || can_fall_back(z, order)) {
+                frame = take_block_in(order, z);
+            }
+            if (frame == UINT32_MAX) {
+                if (order == 0) {
+                    break;
+                }
+                order--;
+                continue;
+            }
+            if (z != zone) {
+                zones[z].fallback_allocs++;
+            }
+            for (uint32_t i = 0; i < (1u << order); i++) {
+                out[got++] = frame + i;
+            }
+        }
+    }
+    used_frames += got;
+    KTRACE(PMM, DEBUG, "[PMM] Allocated %d of %d frames in bulk\n", got, count);
+    return got;
+}
+
+void PhysicalMemoryManager::free_pfns_bulk(uint32_t count, const uint32_t* pfns)
+{
+    // Each run of consecutive frames goes back as maximal aligned blocks; an array filled
+    // by allocate_pfns_bulk consists of exactly such runs.
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t start = pfns[i];
+        uint32_t run = 1;
+        while (i + run < count && pfns[i + run] == start + run) {
+            run++;
+        }
+        i += run;
+        release_range(start, start + run);
+    }
+    KTRACE(PMM, DEBUG, "[PMM] Freed %d frames in bulk\n", count);
+}
+
+// The pointer variants go through the frame-number ones a batch at a time.
+#define PMM_BULK_BATCH 64
+
+uint32_t PhysicalMemoryManager::allocate_frames_bulk(uint32_t count, void** out, pmm_zone zone)
+{
+    uint32_t pfns[PMM_BULK_BATCH];
+    uint32_t got = 0;
+    zone = pointer_zone(zone);
+    while (got < count) {
+        uint32_t want = count - got < PMM_BULK_BATCH ? count - got : PMM_BULK_BATCH;
+        uint32_t n = allocate_pfns_bulk(want, pfns, zone);
+        for (uint32_t i = 0; i < n; i++) {
+            out[got++] = reinterpret_cast<void*>(pfns[i] * PAGE_SIZE);
+        }
+        if (n < want) {
+            break;
+        }
+    }
+    return got;
+}
+
+void PhysicalMemoryManager::free_frames_bulk(uint32_t count, void* const* frame_list)
+{
+    uint32_t pfns[PMM_BULK_BATCH];
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t n = count - done < PMM_BULK_BATCH ? count - done : PMM_BULK_BATCH;
+        for (uint32_t i = 0; i < n; i++) {
+            pfns[i] = reinterpret_cast<uint32_t>(frame_list[done + i]) / PAGE_SIZE;
+        }
+        free_pfns_bulk(n, pfns);
+        done += n;
+    }
+}
+
+void* PhysicalMemoryManager::allocate_frame(pmm_zone zone)
+{
+    return allocate_frames(0, zone);
+}
+
 void PhysicalMemoryManager::free_frame(void* frame)
 {
-    // Convert address => frame index
-    uint32_t frame_idx = reinterpret_cast<uint32_t>(frame) / PAGE_SIZE;
-    clear_frame(frame_idx);
+    free_pfn(reinterpret_cast<uint32_t>(frame) / PAGE_SIZE);
+}
+
+uint32_t PhysicalMemoryManager::allocate_pfn(pmm_zone zone)
+{
+    uint32_t frame = take_block(0, zone);
+    if (frame == UINT32_MAX) {
+        KTRACE(PMM, ERROR, "[PMM] Out of physical frames in %s!\n", zone_name(zone));
+        return 0;
+    }
+    used_frames++;
+    return frame;
+}
+
+void PhysicalMemoryManager::free_pfn(uint32_t pfn)
+{
+    if (pfn >= total_frames) {
+        KTRACE(PMM, ERROR, "[PMM] Bad free of frame 0x%x\n", pfn);
+        return;
+    }
+    if (share_counts[pfn]) {
+        uint32_t flags = irq_save();
+        // A saturated count no longer tracks its sharers; the frame stays pinned.
+        if (share_counts[pfn] != PMM_MAX_SHARES) {
+            share_counts[pfn]--;
+        }
+        irq_restore(flags);
+        return;
+    }
+    put_block(pfn, 0);
     used_frames--;
 }
 
-size_t PhysicalMemoryManager::get_memory_size()
+void PhysicalMemoryManager::share_pfn(uint32_t pfn)
 {
-    return total_frames * PAGE_SIZE;
+    if (pfn >= total_frames) {
+        return;
+    }
+    uint32_t flags = irq_save();
+    if (share_counts[pfn] != PMM_MAX_SHARES) {
+        share_counts[pfn]++;
+    }
+    irq_restore(flags);
+}
+
+uint32_t PhysicalMemoryManager::pfn_refs(uint32_t pfn)
+{
+    if (pfn >= total_frames || !frames.test(pfn)) {
+        return 0;
+    }
+    return 1 + share_counts[pfn];
+}
+
+uint32_t PhysicalMemoryManager::allocate_zeroed_pfn()
+{
+    uint32_t flags = irq_save();
+    uint32_t pfn = 0;
+    if (zero_pool_count > 0) {
+        pfn = zero_pool[--zero_pool_count];
+        zero_pool_hits++;
+    } else {
+        // Pool is empty: zero synchronously.
+        pfn = allocate_pfn();
+        if (pfn) {
+            vmm_zero_pfn(pfn);
+        }
+        zero_pool_misses++;
+    }
+    irq_restore(flags);
+    return pfn;
+}
+
+void* PhysicalMemoryManager::allocate_zeroed_frame()
+{
+    void* frame = allocate_frame(ZONE_DMA);
+    if (frame) {
+        memset(frame, 0, PAGE_SIZE);
+    }
+    return frame;
+}
+
+bool PhysicalMemoryManager::refill_zero_pool(uint32_t budget)
+{
+    for (uint32_t i = 0; i < budget; i++) {
+        uint32_t flags = irq_save();
+        // The pool only takes memory nobody else wants yet: free frames of the highest
+        // zone, and never ZONE_DMA's reserve on machines that have nothing else.
+        pmm_zone top = populated_zone(ZONE_HIGH);
+        if (zero_pool_count >= PMM_ZERO_POOL_SIZE ||
+            zones[top].free_frames <= (top == ZONE_DMA ? PMM_ZONE_RESERVE : 0)) {
+            irq_restore(flags);
+            return false;
+        }
+        uint32_t pfn = allocate_pfn(top);
+        vmm_zero_pfn(pfn);
+        zero_pool[zero_pool_count++] = pfn;
+        irq_restore(flags);
+    }
+    return zero_pool_count < PMM_ZERO_POOL_SIZE;
+}
+
+uint32_t PhysicalMemoryManager::zero_pool_level()
+{
+    return zero_pool_count;
+}
+
+void PhysicalMemoryManager::get_zone_stats(pmm_zone zone, pmm_zone_stats_t* out)
+{
+    *out = zones[zone];
+}
+
+const char* PhysicalMemoryManager::zone_name(pmm_zone zone)
+{
+    static const char* const names[ZONE_COUNT] = {"DMA", "Normal", "High"};
+    return names[zone];
+}
+
+uint64_t PhysicalMemoryManager::get_memory_size()
+{
+    return (uint64_t)total_frames * PAGE_SIZE;
+}
+
+uint32_t PhysicalMemoryManager::get_total_frames()
+{
+    return total_frames;
 }
 
 size_t PhysicalMemoryManager::get_free_frames()
@@ -88,27 +651,27 @@ size_t PhysicalMemoryManager::get_free_frames()
 
 void PhysicalMemoryManager::set_frame(uint32_t frame_addr)
 {
-    uint32_t bit = frame_addr % 32;
-    uint32_t idx = frame_addr / 32;
-    bitmap[idx] |= (1 << bit);
+    frames.set(frame_addr);
 }
 
 void PhysicalMemoryManager::clear_frame(uint32_t frame_addr)
 {
-    uint32_t bit = frame_addr % 32;
-    uint32_t idx = frame_addr / 32;
-    bitmap[idx] &= ~(1 << bit);
+    frames.clear(frame_addr);
 }
 
 uint32_t PhysicalMemoryManager::test_frame(uint32_t frame_addr)
 {
-    uint32_t bit = frame_addr % 32;
-    uint32_t idx = frame_addr / 32;
-    return (bitmap[idx] & (1 << bit)) != 0;
+    return frames.test(frame_addr);
 }
 
 uint32_t PhysicalMemoryManager::first_free()
 {
+    return frames.find_clear();
+}
+
+uint32_t PhysicalMemoryManager::first_free_linear()
+{
+    const uint32_t* bitmap = frames.words();
     // number of 32-bit entries in the bitmap
     uint32_t bm_size = total_frames / 32;
     if (total_frames % 32) {
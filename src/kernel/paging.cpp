@@ -2,33 +2,73 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <kernel/trace.h>
 #include <kernel/isr.h>
+#include <kernel/memory.h>
+#include <kernel/cpu.h>
+#include <kernel/vma.h>
 
-// Define heap boundaries to avoid conflicts with paging
-#define KERNEL_HEAP_START 0x00800000  // Heap starts at 8 MiB
-#define KERNEL_HEAP_SIZE  0x00800000  // Heap spans 8 MiB (up to 16 MiB)
-
-// Page directory (1024 entries) and four page tables (each 4 MiB)
-static uint32_t kernel_page_directory[1024]
+// Page directory (VMM_DIR_PAGES pages of PDE_ENTRIES each) and the page tables that cover
+// the identity range when it is not mapped with large pages.
+static vmm_entry_t kernel_page_directory[VMM_DIR_SLOTS]
     __attribute__((aligned(4096), section(".lowmem")));
 
-static uint32_t kernel_page_table0[1024]
+static vmm_entry_t kernel_identity_tables[VMM_IDENTITY_LIMIT / PAGE_SIZE]
     __attribute__((aligned(4096), section(".lowmem")));
 
-static uint32_t kernel_page_table1[1024]
-    __attribute__((aligned(4096), section(".lowmem")));
+#if VMM_USE_PAE
+// CR3 points here: one entry per directory page, present bit only.
+static uint64_t kernel_pdpt[VMM_DIR_PAGES]
+    __attribute__((aligned(32), section(".lowmem")));
+#endif
 
-static uint32_t kernel_page_table2[1024]
-    __attribute__((aligned(4096), section(".lowmem")));
+// Set by vmm_init when the identity map is built from large pages.
+static bool large_pages = false;
 
-static uint32_t kernel_page_table3[1024]
-    __attribute__((aligned(4096), section(".lowmem")));
+// PTE_GLOBAL if the CPU supports global pages, 0 otherwise (the bit is reserved there).
+static uint32_t global_flag = 0;
+
+static inline uint32_t kernel_global(uint32_t virtual_addr)
+{
+    return (virtual_addr < VMM_IDENTITY_LIMIT || virtual_addr >= VMM_KERNEL_BASE) ? global_flag : 0;
+}
+
+// Directory slots outside [VMM_PRIVATE_START, VMM_PRIVATE_END) point at the same page
+// tables in every address space; kernel_page_directory is their master copy.
+static inline bool is_private(uint32_t virtual_addr)
+{
+    return virtual_addr >= VMM_PRIVATE_START && virtual_addr < VMM_PRIVATE_END;
+}
+
+// The directory handle CR3 holds for the boot address space.
+static inline uint32_t kernel_directory()
+{
+#if VMM_USE_PAE
+    return (uint32_t)kernel_pdpt;
+#else
+    return (uint32_t)kernel_page_directory;
+#endif
+}
+
+static inline phys_addr_t pfn_to_phys(uint32_t pfn)
+{
+    return (phys_addr_t)pfn << 12;
+}
+
+static int cow_fault(uint32_t fault_addr, uint32_t err_code);
 
 // Page fault handler
 void page_fault_handler(registers_t *registers) {
     uint32_t fault_addr;
     asm("mov %%cr2, %0" : "=r"(fault_addr));
-    
+
+    // Writes to shared copy-on-write pages get a private copy and lazily backed areas
+    // get their page; either way the access is retried.
+    if (cow_fault(fault_addr, registers->err_code) ||
+        vma_handle_fault(fault_addr, registers->err_code)) {
+        return;
+    }
+
     printf("[VMM] Page Fault at 0x%x\n", fault_addr);
     printf("[VMM] Page info: 0x%x\n", registers->eip);
     printf("[VMM] Page fault caused by %s access\n",
@@ -45,67 +85,103 @@ void page_fault_handler(registers_t *registers) {
 
 void vmm_init()
 {
-    printf("[VMM] Initializing paging (identity map 0..16 MiB)\n");
+    KTRACE(VMM, INFO, "[VMM] Initializing %s paging (identity map 0..16 MiB)\n",
+           VMM_USE_PAE ? "PAE" : "32-bit");
 
     // Register the page fault handler
     register_interrupt_handler(14, page_fault_handler);
 
-    // 1) Clear the page directory and tables
+#if VMM_USE_PAE
+    // The table layout is fixed at build time; there is nothing to fall back to.
+    if (!cpu_has_edx_features(CPUID_FEAT_EDX_PAE)) {
+        printf("[VMM] This kernel was built with VMM_USE_PAE=1 but the CPU lacks PAE\n");
+        for (;;) asm("hlt");
+    }
+#endif
+
+    // 1) Clear the page directory
     memset(kernel_page_directory, 0, sizeof(kernel_page_directory));
-    memset(kernel_page_table0, 0, sizeof(kernel_page_table0));
-    memset(kernel_page_table1, 0, sizeof(kernel_page_table1));
-    memset(kernel_page_table2, 0, sizeof(kernel_page_table2));
-    memset(kernel_page_table3, 0, sizeof(kernel_page_table3));
 
-    // 2) Fill the four page tables (0–4MiB, 4–8MiB, 8–12MiB, 12–16MiB)
-    printf("[VMM] Mapping [0..16 MiB]\n");
-    uint32_t* tables[] = {kernel_page_table0, kernel_page_table1, kernel_page_table2, kernel_page_table3};
-    for (int table_idx = 0; table_idx < 4; table_idx++) {
-        for (uint32_t i = 0; i < 1024; i++) {
-            uint32_t phys_addr = (table_idx * 0x400000) + (i * 0x1000);
-            tables[table_idx][i] = (phys_addr & 0xFFFFF000) | 0x03; // Present + RW
+    // PAE always honours large PDEs; 32-bit paging needs PSE for them.
+    large_pages = VMM_USE_PSE && (VMM_USE_PAE || cpu_has_edx_features(CPUID_FEAT_EDX_PSE));
+    global_flag = cpu_has_edx_features(CPUID_FEAT_EDX_PGE) ? PTE_GLOBAL : 0;
+    if (large_pages) {
+        // 2) One large PDE per LARGE_PAGE_SIZE of the identity range; no page tables needed.
+        //    vmm_map splits a large page into a table if it ever has to change one page.
+        KTRACE(VMM, DEBUG, "[VMM] Mapping [0..16 MiB] with %d KiB pages\n", LARGE_PAGE_SIZE / 1024);
+        for (uint32_t pd_index = 0; pd_index < VMM_IDENTITY_LIMIT / LARGE_PAGE_SIZE; pd_index++) {
+            kernel_page_directory[pd_index] =
+                (pd_index * LARGE_PAGE_SIZE) | global_flag | PDE_LARGE | PTE_RW | PTE_PRESENT;
+        }
+    } else {
+        // 2) Fill the identity page tables, PTE_ENTRIES pages each
+        KTRACE(VMM, DEBUG, "[VMM] Mapping [0..16 MiB]\n");
+        for (uint32_t i = 0; i < VMM_IDENTITY_LIMIT / PAGE_SIZE; i++) {
+            kernel_identity_tables[i] = (i * PAGE_SIZE) | global_flag | 0x03; // Present + RW
+        }
+
+        // 3) Map the page tables in the directory
+        for (uint32_t pd_index = 0; pd_index < VMM_IDENTITY_LIMIT >> PDE_SHIFT; pd_index++) {
+            kernel_page_directory[pd_index] =
+                ((uint32_t)&kernel_identity_tables[pd_index * PTE_ENTRIES] & 0xFFFFF000) | 0x03;
         }
     }
 
-    // 3) Map the page tables in the directory
-    kernel_page_directory[0] = ((uint32_t)kernel_page_table0 & 0xFFFFF000) | 0x03;
-    kernel_page_directory[1] = ((uint32_t)kernel_page_table1 & 0xFFFFF000) | 0x03;
-    kernel_page_directory[2] = ((uint32_t)kernel_page_table2 & 0xFFFFF000) | 0x03;
-    kernel_page_directory[3] = ((uint32_t)kernel_page_table3 & 0xFFFFF000) | 0x03;
+    KTRACE(VMM, DEBUG, "[VMM] PDE[0] = 0x%x\n", (uint32_t)kernel_page_directory[0]);
+    KTRACE(VMM, DEBUG, "[VMM] PDE[1] = 0x%x\n", (uint32_t)kernel_page_directory[1]);
 
-    printf("[VMM] PDE[0] = 0x%x\n", kernel_page_directory[0]);
-    printf("[VMM] PDE[1] = 0x%x\n", kernel_page_directory[1]);
-    printf("[VMM] PDE[2] = 0x%x\n", kernel_page_directory[2]);
-    printf("[VMM] PDE[3] = 0x%x\n", kernel_page_directory[3]);
+    // 4) Point the last directory slots back at the directory pages themselves. With
+    //    paging on, every page table then shows up at VMM_PAGE_TABLES and the directory
+    //    at VMM_PAGE_DIRECTORY, wherever their frames live.
+    for (uint32_t i = 0; i < VMM_DIR_PAGES; i++) {
+        uint32_t page = (uint32_t)&kernel_page_directory[i * PDE_ENTRIES];
+        kernel_page_directory[VMM_RECURSIVE_SLOT + i] = (page & 0xFFFFF000) | 0x03;
+#if VMM_USE_PAE
+        kernel_pdpt[i] = page | PTE_PRESENT;
+#endif
+    }
 
-    // Print first few entries for debugging
-    printf("[VMM] First 4 entries of page_table0:\n");
-    for (int i = 0; i < 4; i++) {
-        printf("  PT0[%d] = 0x%x\n", i, kernel_page_table0[i]);
+    // 5) Give VMM_TEMP_PAGE its page table now, so vmm_zero_frame never has to
+    //    allocate one (which may itself need a zeroed frame).
+    void* temp_table = PhysicalMemoryManager::allocate_frame(ZONE_DMA);
+    if (temp_table) {
+        memset(temp_table, 0, PAGE_SIZE);
+        kernel_page_directory[VMM_TEMP_PAGE >> PDE_SHIFT] = ((uint32_t)temp_table & 0xFFFFF000) | 0x03;
     }
-    
-    printf("[VMM] PDE @ 0x%x\n", (uint32_t)kernel_page_directory);
+
+    KTRACE(VMM, DEBUG, "[VMM] PDE @ 0x%x\n", (uint32_t)kernel_page_directory);
 }
 
 void vmm_enable()
 {
-    printf("[VMM] Enabling paging...\n");
+    KTRACE(VMM, INFO, "[VMM] Enabling paging...\n");
 
     asm volatile("cli");
 
-    // Load CR3 (physical address of page directory)
-    uint32_t pde_phys = (uint32_t)kernel_page_directory;
-    printf("[VMM] Loading CR3 with 0x%x\n", pde_phys);
+    // Large PDEs are only honoured with CR4.PSE set (or CR4.PAE), global entries with
+    // CR4.PGE.
+    if (VMM_USE_PAE) {
+        write_cr4(read_cr4() | CR4_PAE);
+    } else if (large_pages) {
+        write_cr4(read_cr4() | CR4_PSE);
+    }
+    if (global_flag) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+
+    // Load CR3 (physical address of the page directory, or of the PDPT with PAE)
+    uint32_t pde_phys = kernel_directory();
+    KTRACE(VMM, DEBUG, "[VMM] Loading CR3 with 0x%x\n", pde_phys);
     asm volatile("mov %0, %%cr3" :: "r"(pde_phys));
 
     // Enable paging in CR0
     uint32_t cr0;
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    printf("[VMM] Old CR0 = 0x%x\n", cr0);
+    KTRACE(VMM, DEBUG, "[VMM] Old CR0 = 0x%x\n", cr0);
 
     cr0 |= 0x80000000;  // Set PG bit
     cr0 |= 0x00000001;  // Ensure PE bit is set
-    printf("[VMM] New CR0 = 0x%x\n", cr0);
+    KTRACE(VMM, DEBUG, "[VMM] New CR0 = 0x%x\n", cr0);
 
     asm volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
 
@@ -115,30 +191,525 @@ void vmm_enable()
         "1:\n"
     );
 
-    printf("[VMM] Paging enabled successfully.\n");
+    KTRACE(VMM, INFO, "[VMM] Paging enabled successfully.\n");
+}
+
+int vmm_large_pages_enabled()
+{
+    return large_pages;
+}
+
+void vmm_flush_tlb()
+{
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+}
+
+void vmm_flush_tlb_all()
+{
+    if (!global_flag) {
+        vmm_flush_tlb();
+        return;
+    }
+    // Toggling CR4.PGE invalidates every entry, global ones included.
+    uint32_t flags = irq_save();
+    uint32_t cr4 = read_cr4();
+    write_cr4(cr4 & ~CR4_PGE);
+    write_cr4(cr4);
+    irq_restore(flags);
+}
+
+static inline void invlpg(uint32_t virtual_addr)
+{
+    asm volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+}
+
+// Map 'physical_addr' at VMM_TEMP_PAGE, whose page table vmm_init preallocated. The
+// caller keeps interrupts disabled until temp_unmap.
+static void* temp_map(phys_addr_t physical_addr)
+{
+    *vmm_pte_addr(VMM_TEMP_PAGE) = (physical_addr & PTE_ADDR_MASK) | PTE_RW | PTE_PRESENT;
+    invlpg(VMM_TEMP_PAGE);
+    return (void*)VMM_TEMP_PAGE;
+}
+
+static void temp_unmap()
+{
+    *vmm_pte_addr(VMM_TEMP_PAGE) = 0;
+    invlpg(VMM_TEMP_PAGE);
+}
+
+// Install a PDE in the current directory, and in the master copy if the slot is shared.
+static void set_pde(uint32_t virtual_addr, vmm_entry_t pde_val)
+{
+    *vmm_pde_addr(virtual_addr) = pde_val;
+    if (!is_private(virtual_addr)) {
+        kernel_page_directory[virtual_addr >> PDE_SHIFT] = pde_val;
+    }
 }
 
-void vmm_map(uint32_t virtual_addr, uint32_t physical_addr, int rw)
+// Replace the large page at 'pd_index' with a page table mapping the same range.
+// Returns the new PDE, or 0 if no frame was available for the table.
+static vmm_entry_t split_large_page(uint32_t pd_index)
 {
-    printf("[VMM] Mapping vaddr=0x%x to paddr=0x%x, rw=%d\n", virtual_addr, physical_addr, rw);
+    uint32_t virtual_addr = pd_index << PDE_SHIFT;
+    vmm_entry_t pde_val = *vmm_pde_addr(virtual_addr);
+    uint32_t pfn = PhysicalMemoryManager::allocate_pfn();
+    if (!pfn) {
+        KTRACE(VMM, ERROR, "[VMM] Out of memory splitting PDE[%d]!\n", pd_index);
+        return 0;
+    }
+
+    // The range stays mapped while the table is built (the kernel itself may live in it),
+    // so fill the table through the scratch page and only then swap the PDE.
+    phys_addr_t base = pde_val & PTE_ADDR_MASK & ~(phys_addr_t)(LARGE_PAGE_SIZE - 1);
+    uint32_t flags = pde_val & (PTE_GLOBAL | PTE_RW | PTE_PRESENT);
+    uint32_t irq = irq_save();
+    vmm_entry_t* table = (vmm_entry_t*)temp_map(pfn_to_phys(pfn));
+    for (uint32_t i = 0; i < PTE_ENTRIES; i++) {
+        table[i] = (base + i * PAGE_SIZE) | flags;
+    }
+    temp_unmap();
+    irq_restore(irq);
+
+    pde_val = pfn_to_phys(pfn) | (flags & (PTE_RW | PTE_PRESENT));
+    set_pde(virtual_addr, pde_val);
 
-    uint32_t pd_index = (virtual_addr >> 22) & 0x3FF;
-    uint32_t pt_index = (virtual_addr >> 12) & 0x3FF;
+    // invlpg on any address inside the large page drops its TLB entry. The table's
+    // window page used to alias the large page itself, so drop that one too.
+    invlpg(virtual_addr);
+    invlpg((uint32_t)vmm_pte_addr(virtual_addr));
+    KTRACE(VMM, DEBUG, "[VMM] Split large page at 0x%x\n", virtual_addr);
+    return pde_val;
+}
 
-    uint32_t pde_val = kernel_page_directory[pd_index];
+// Page table covering 'virtual_addr', allocated on demand if 'create' is set. A large
+// page in the way is split first. Returns the table's address in the recursive window,
+// or NULL if there is no table (or no memory).
+static vmm_entry_t* page_table_for(uint32_t virtual_addr, bool create)
+{
+    uint32_t pd_index = virtual_addr >> PDE_SHIFT;
+    vmm_entry_t pde_val = *vmm_pde_addr(virtual_addr);
+    vmm_entry_t* table = vmm_pte_addr(virtual_addr & ~(LARGE_PAGE_SIZE - 1));
     if ((pde_val & 1) == 0) {
-        printf("[VMM] PDE[%d] not present!\n", pd_index);
+        if (!create) {
+            return NULL;
+        }
+        // Allocate a page table on demand from the pre-zeroed pool. It may be any
+        // frame, since the table is only reached through the recursive window.
+        uint32_t pfn = PhysicalMemoryManager::allocate_zeroed_pfn();
+        if (!pfn) {
+            KTRACE(VMM, ERROR, "[VMM] Out of memory for PDE[%d]!\n", pd_index);
+            return NULL;
+        }
+        set_pde(virtual_addr, pfn_to_phys(pfn) | 0x03);
+        invlpg((uint32_t)table);
+    } else if (pde_val & PDE_LARGE) {
+        if (!split_large_page(pd_index)) {
+            return NULL;
+        }
+    }
+    return table;
+}
+
+// Invalidate the pages of a range after its PTEs changed: page by page for small
+// ranges, one full flush above VMM_FLUSH_THRESHOLD pages.
+static void flush_range(uint32_t virtual_addr, uint32_t pages)
+{
+    if (pages > VMM_FLUSH_THRESHOLD) {
+        if (kernel_global(virtual_addr)) {
+            vmm_flush_tlb_all();
+        } else {
+            vmm_flush_tlb();
+        }
         return;
     }
+    for (uint32_t i = 0; i < pages; i++) {
+        invlpg(virtual_addr + i * PAGE_SIZE);
+    }
+}
+
+static int map_page(uint32_t virtual_addr, uint32_t pfn, uint32_t flags)
+{
+    vmm_entry_t* table = page_table_for(virtual_addr, true);
+    if (!table) {
+        return 0;
+    }
+    uint32_t pt_index = (virtual_addr >> 12) & (PTE_ENTRIES - 1);
+    table[pt_index] = pfn_to_phys(pfn) | flags | kernel_global(virtual_addr);
 
-    uint32_t pt_phys_base = pde_val & 0xFFFFF000;
-    uint32_t* pt_virt_base = (uint32_t*)pt_phys_base; // Identity-mapped
+    KTRACE(VMM, DEBUG, "[VMM] PT[%d] = 0x%x\n", pt_index, (uint32_t)table[pt_index]);
 
-    uint32_t flags = (rw ? 0x3 : 0x1);
-    pt_virt_base[pt_index] = (physical_addr & 0xFFFFF000) | flags;
+    invlpg(virtual_addr);
+    return 1;
+}
+
+int vmm_map_pfn(uint32_t virtual_addr, uint32_t pfn, int rw)
+{
+    KTRACE(VMM, DEBUG, "[VMM] Mapping vaddr=0x%x to pfn=0x%x, rw=%d\n", virtual_addr, pfn, rw);
+    return map_page(virtual_addr, pfn, rw ? 0x3 : 0x1);
+}
 
-    printf("[VMM] PT[%d] = 0x%x\n", pt_index, pt_virt_base[pt_index]);
+int vmm_map_mmio(uint32_t virtual_addr, uint32_t physical_addr)
+{
+    KTRACE(VMM, DEBUG, "[VMM] Mapping device page vaddr=0x%x to phys=0x%x\n", virtual_addr, physical_addr);
+    return map_page(virtual_addr, physical_addr >> 12, PTE_PRESENT | PTE_RW | PTE_PWT | PTE_PCD);
+}
 
-    asm volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
-    printf("[VMM] Mapping done.\n");
+int vmm_map(uint32_t virtual_addr, uint32_t physical_addr, int rw)
+{
+    return vmm_map_pfn(virtual_addr, physical_addr >> 12, rw);
+}
+
+uint32_t vmm_unmap_pfn(uint32_t virtual_addr)
+{
+    vmm_entry_t* table = page_table_for(virtual_addr, false);
+    if (!table) {
+        return 0;
+    }
+    uint32_t pt_index = (virtual_addr >> 12) & (PTE_ENTRIES - 1);
+    vmm_entry_t pte_val = table[pt_index];
+    if ((pte_val & 1) == 0) {
+        return 0;
+    }
+
+    table[pt_index] = 0;
+    invlpg(virtual_addr);
+    return (uint32_t)((pte_val & PTE_ADDR_MASK) >> 12);
+}
+
+uint32_t vmm_unmap(uint32_t virtual_addr)
+{
+    return vmm_unmap_pfn(virtual_addr) << 12;
+}
+
+int vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, int rw)
+{
+    return vmm_map_range_pfn(virtual_addr, physical_addr >> 12, size, rw);
+}
+
+int vmm_map_range_pfn(uint32_t virtual_addr, uint32_t pfn, uint32_t size, int rw)
+{
+    KTRACE(VMM, DEBUG, "[VMM] Mapping 0x%x bytes at vaddr=0x%x to frame 0x%x\n", size, virtual_addr, pfn);
+
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t flags = (rw ? 0x3 : 0x1) | kernel_global(virtual_addr);
+    uint32_t replaced = 0;  // Only entries that were present can be cached in the TLB
+
+    uint32_t i = 0;
+    while (i < pages) {
+        uint32_t va = virtual_addr + i * PAGE_SIZE;
+        vmm_entry_t* table = page_table_for(va, true);
+        if (!table) {
+            vmm_unmap_range(virtual_addr, i * PAGE_SIZE, NULL);
+            return 0;
+        }
+        // Fill the rest of this page table in one go.
+        for (uint32_t pt_index = (va >> 12) & (PTE_ENTRIES - 1); pt_index < PTE_ENTRIES && i < pages; pt_index++, i++) {
+            if (table[pt_index] & 1) {
+                replaced++;
+            }
+            table[pt_index] = pfn_to_phys(pfn + i) | flags;
+        }
+    }
+
+    if (replaced) {
+        flush_range(virtual_addr, pages);
+    }
+    return 1;
+}
+
+uint32_t vmm_unmap_range(uint32_t virtual_addr, uint32_t size, uint32_t* pfn_out)
+{
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t unmapped = 0;
+
+    uint32_t i = 0;
+    while (i < pages) {
+        uint32_t va = virtual_addr + i * PAGE_SIZE;
+        vmm_entry_t* table = page_table_for(va, false);
+        uint32_t pt_index = (va >> 12) & (PTE_ENTRIES - 1);
+        for (; pt_index < PTE_ENTRIES && i < pages; pt_index++, i++) {
+            vmm_entry_t pte_val = table ? table[pt_index] : 0;
+            if (pfn_out) {
+                pfn_out[i] = (pte_val & 1) ? (uint32_t)((pte_val & PTE_ADDR_MASK) >> 12) : 0;
+            }
+            if (pte_val & 1) {
+                table[pt_index] = 0;
+                unmapped++;
+            }
+        }
+    }
+
+    if (unmapped) {
+        flush_range(virtual_addr, pages);
+    }
+    return unmapped;
+}
+
+void vmm_zero_pfn(uint32_t pfn)
+{
+    if (pfn < VMM_IDENTITY_LIMIT / PAGE_SIZE) {
+        memset((void*)(pfn * PAGE_SIZE), 0, PAGE_SIZE);
+        return;
+    }
+    memset(temp_map(pfn_to_phys(pfn)), 0, PAGE_SIZE);
+    temp_unmap();
+}
+
+int vmm_protect(uint32_t virtual_addr, int rw)
+{
+    vmm_entry_t pde_val = *vmm_pde_addr(virtual_addr);
+    if ((pde_val & 1) == 0) {
+        return 0;
+    }
+    vmm_entry_t* entry = (pde_val & PDE_LARGE) ? vmm_pde_addr(virtual_addr) : vmm_pte_addr(virtual_addr);
+    if ((*entry & 1) == 0) {
+        return 0;
+    }
+    // Changing a whole large page is fine here: the identity map is the only user.
+    *entry = rw ? (*entry | PTE_RW) : (*entry & ~(vmm_entry_t)PTE_RW);
+    invlpg(virtual_addr);
+    return 1;
+}
+
+uint32_t vmm_translate(uint32_t virtual_addr)
+{
+    vmm_entry_t pde_val = *vmm_pde_addr(virtual_addr);
+    if ((pde_val & 1) == 0) {
+        return 0;
+    }
+    phys_addr_t physical_addr;
+    if (pde_val & PDE_LARGE) {
+        physical_addr = (pde_val & PTE_ADDR_MASK & ~(phys_addr_t)(LARGE_PAGE_SIZE - 1)) |
+                        (virtual_addr & (LARGE_PAGE_SIZE - 1));
+    } else {
+        vmm_entry_t pte_val = *vmm_pte_addr(virtual_addr);
+        if ((pte_val & 1) == 0) {
+            return 0;
+        }
+        physical_addr = (pte_val & PTE_ADDR_MASK) | (virtual_addr & (PAGE_SIZE - 1));
+    }
+    return physical_addr == (uint32_t)physical_addr ? (uint32_t)physical_addr : 0;
+}
+
+uint32_t vmm_cow_copies = 0;
+
+// Resolve a write to a read-only PTE_COW page: copy the frame unless this mapping has
+// become its last user, then make the page writable again.
+static int cow_fault(uint32_t fault_addr, uint32_t err_code)
+{
+    if ((err_code & 0x3) != 0x3) {  // Present + write
+        return 0;
+    }
+    vmm_entry_t pde_val = *vmm_pde_addr(fault_addr);
+    if ((pde_val & 1) == 0 || (pde_val & PDE_LARGE)) {
+        return 0;
+    }
+    vmm_entry_t* entry = vmm_pte_addr(fault_addr);
+    if ((*entry & PTE_COW) == 0) {
+        return 0;
+    }
+
+    uint32_t page = fault_addr & ~(PAGE_SIZE - 1);
+    uint32_t old_pfn = (uint32_t)((*entry & PTE_ADDR_MASK) >> 12);
+    uint32_t flags = ((uint32_t)*entry & 0xFFF & ~PTE_COW) | PTE_RW;
+    if (PhysicalMemoryManager::pfn_refs(old_pfn) == 1) {
+        *entry = pfn_to_phys(old_pfn) | flags;
+        invlpg(page);
+        return 1;
+    }
+
+    uint32_t new_pfn = PhysicalMemoryManager::allocate_pfn();
+    if (!new_pfn) {
+        KTRACE(VMM, ERROR, "[VMM] Out of memory copying page 0x%x\n", page);
+        return 0;
+    }
+    memcpy(temp_map(pfn_to_phys(new_pfn)), (void*)page, PAGE_SIZE);
+    temp_unmap();
+    *entry = pfn_to_phys(new_pfn) | flags;
+    invlpg(page);
+    PhysicalMemoryManager::free_pfn(old_pfn);
+    vmm_cow_copies++;
+    return 1;
+}
+
+// Directory contents staged by clone and destroy, which can only reach a directory other
+// than the current one through the scratch page. Both run with interrupts disabled.
+static vmm_entry_t scratch_directory[VMM_DIR_SLOTS];
+
+// Physical addresses of the directory pages behind a directory handle. With PAE the
+// handle is a PDPT, which always lives in identity-mapped memory.
+static void directory_pages(uint32_t directory, phys_addr_t* pages)
+{
+#if VMM_USE_PAE
+    const uint64_t* pdpt = (const uint64_t*)directory;
+    for (uint32_t i = 0; i < VMM_DIR_PAGES; i++) {
+        pages[i] = pdpt[i] & PTE_ADDR_MASK;
+    }
+#else
+    pages[0] = directory;
+#endif
+}
+
+// Release a directory handle and its directory pages (not the tables they point to).
+static void free_directory_pages(uint32_t directory)
+{
+#if VMM_USE_PAE
+    const uint64_t* pdpt = (const uint64_t*)directory;
+    for (uint32_t i = 0; i < VMM_DIR_PAGES; i++) {
+        if (pdpt[i] & PTE_PRESENT) {
+            PhysicalMemoryManager::free_pfn((uint32_t)(pdpt[i] >> 12));
+        }
+    }
+#endif
+    PhysicalMemoryManager::free_frame((void*)directory);
+}
+
+// A fresh directory handle with all its directory pages allocated, or 0.
+static uint32_t alloc_directory_pages()
+{
+#if VMM_USE_PAE
+    uint64_t* pdpt = (uint64_t*)PhysicalMemoryManager::allocate_zeroed_frame();
+    if (!pdpt) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < VMM_DIR_PAGES; i++) {
+        uint32_t pfn = PhysicalMemoryManager::allocate_pfn();
+        if (!pfn) {
+            free_directory_pages((uint32_t)pdpt);
+            return 0;
+        }
+        pdpt[i] = pfn_to_phys(pfn) | PTE_PRESENT;
+    }
+    return (uint32_t)pdpt;
+#else
+    return (uint32_t)PhysicalMemoryManager::allocate_frame();
+#endif
+}
+
+uint32_t vmm_current_directory()
+{
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return VMM_USE_PAE ? (cr3 & ~0x1Fu) : (cr3 & 0xFFFFF000);
+}
+
+void vmm_switch_directory(uint32_t directory)
+{
+    // Shared slots are only kept current in the loaded directory and the master; bring
+    // the incoming one up to date with tables added or split since it was last loaded.
+    phys_addr_t pages[VMM_DIR_PAGES];
+    directory_pages(directory, pages);
+    uint32_t irq = irq_save();
+    for (uint32_t page = 0; page < VMM_DIR_PAGES; page++) {
+        vmm_entry_t* target = (vmm_entry_t*)temp_map(pages[page]);
+        for (uint32_t i = 0; i < PDE_ENTRIES; i++) {
+            uint32_t pd_index = page * PDE_ENTRIES + i;
+            if (pd_index < VMM_RECURSIVE_SLOT && !is_private(pd_index << PDE_SHIFT)) {
+                target[i] = kernel_page_directory[pd_index];
+            }
+        }
+    }
+    temp_unmap();
+    asm volatile("mov %0, %%cr3" :: "r"(directory) : "memory");
+    irq_restore(irq);
+}
+
+uint32_t vmm_clone_directory()
+{
+    uint32_t directory = alloc_directory_pages();
+    if (!directory) {
+        return 0;
+    }
+    phys_addr_t pages[VMM_DIR_PAGES];
+    directory_pages(directory, pages);
+
+    uint32_t irq = irq_save();
+    bool failed = false;
+    for (uint32_t pd_index = 0; pd_index < VMM_DIR_SLOTS; pd_index++) {
+        uint32_t virtual_addr = pd_index << PDE_SHIFT;
+        vmm_entry_t pde_val = *vmm_pde_addr(virtual_addr);
+        if (pd_index >= VMM_RECURSIVE_SLOT) {
+            scratch_directory[pd_index] = pages[pd_index - VMM_RECURSIVE_SLOT] | 0x03;
+            continue;
+        }
+        // Shared slots are linked as they are. Private large pages never occur (only
+        // the identity map uses them), so a present private slot is always a table.
+        if (!is_private(virtual_addr) || (pde_val & 1) == 0 || (pde_val & PDE_LARGE)) {
+            scratch_directory[pd_index] = pde_val;
+            continue;
+        }
+        if (failed) {
+            scratch_directory[pd_index] = 0;
+            continue;
+        }
+
+        uint32_t table_pfn = PhysicalMemoryManager::allocate_pfn();
+        if (!table_pfn) {
+            failed = true;
+            scratch_directory[pd_index] = 0;
+            continue;
+        }
+        // Both sides lose write access; the first writer gets its own copy.
+        vmm_entry_t* parent = vmm_pte_addr(virtual_addr);
+        vmm_entry_t* child = (vmm_entry_t*)temp_map(pfn_to_phys(table_pfn));
+        for (uint32_t i = 0; i < PTE_ENTRIES; i++) {
+            vmm_entry_t pte_val = parent[i];
+            if (pte_val & 1) {
+                if (pte_val & PTE_RW) {
+                    pte_val = (pte_val & ~(vmm_entry_t)PTE_RW) | PTE_COW;
+                    parent[i] = pte_val;
+                }
+                PhysicalMemoryManager::share_pfn((uint32_t)((pte_val & PTE_ADDR_MASK) >> 12));
+            }
+            child[i] = pte_val;
+        }
+        temp_unmap();
+        scratch_directory[pd_index] = pfn_to_phys(table_pfn) | ((uint32_t)pde_val & 0xFFF);
+    }
+
+    for (uint32_t page = 0; page < VMM_DIR_PAGES; page++) {
+        memcpy(temp_map(pages[page]), &scratch_directory[page * PDE_ENTRIES], PAGE_SIZE);
+    }
+    temp_unmap();
+    vmm_flush_tlb();  // Parent PTEs lost write access; private pages are never global
+    irq_restore(irq);
+
+    if (failed) {
+        vmm_destroy_directory(directory);
+        return 0;
+    }
+    return directory;
+}
+
+void vmm_destroy_directory(uint32_t directory)
+{
+    if (directory == vmm_current_directory() || directory == kernel_directory()) {
+        return;
+    }
+    phys_addr_t pages[VMM_DIR_PAGES];
+    directory_pages(directory, pages);
+
+    uint32_t irq = irq_save();
+    for (uint32_t page = 0; page < VMM_DIR_PAGES; page++) {
+        memcpy(&scratch_directory[page * PDE_ENTRIES], temp_map(pages[page]), PAGE_SIZE);
+    }
+    for (uint32_t pd_index = 0; pd_index < VMM_RECURSIVE_SLOT; pd_index++) {
+        vmm_entry_t pde_val = scratch_directory[pd_index];
+        if (!is_private(pd_index << PDE_SHIFT) || (pde_val & 1) == 0 || (pde_val & PDE_LARGE)) {
+            continue;
+        }
+        vmm_entry_t* table = (vmm_entry_t*)temp_map(pde_val & PTE_ADDR_MASK);
+        for (uint32_t i = 0; i < PTE_ENTRIES; i++) {
+            if (table[i] & 1) {
+                PhysicalMemoryManager::free_pfn((uint32_t)((table[i] & PTE_ADDR_MASK) >> 12));
+            }
+        }
+        PhysicalMemoryManager::free_pfn((uint32_t)((pde_val & PTE_ADDR_MASK) >> 12));
+    }
+    temp_unmap();
+    irq_restore(irq);
+    free_directory_pages(directory);
 }
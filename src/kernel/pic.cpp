@@ -32,13 +32,18 @@ void pic_remap() {
     outb(PIC2_DATA, a2);io_wait();
 }
 
+// No io_wait here: an EOI is a single command write, not part of an init sequence.
 void pic_send_eoi(uint8_t irq) {
     if (irq >= 8) {
         outb(PIC2_COMMAND, PIC_EOI);
-        io_wait();
     }
     outb(PIC1_COMMAND, PIC_EOI);
-    io_wait();
+}
+
+// Mask every line, once the APIC has taken over interrupt routing.
+void pic_disable() {
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
 }
 
 
@@ -1,20 +1,47 @@
 #include "kernel/ramfs.h"
 #include "stdio.h"
+#include "kernel/trace.h"
 #include "string.h"
 #include "kernel/heap.h"
+#include "kernel/kmem_cache.h"
 #include "string.h"
 
-// For dynamic allocation, we assume a kernel allocator is available.
+// Nodes and directory child arrays come from their own object caches; file contents
+// still come from the general heap.
 
 static FSNode *root = NULL;
 FileDescriptor fd_table[MAX_OPEN_FILES];
 
+static kmem_cache_t *node_cache = NULL;
+static kmem_cache_t *children_cache = NULL;
+
+static void node_ctor(void *obj)
+{
+    memset(obj, 0, sizeof(FSNode));
+}
+
+static void children_ctor(void *obj)
+{
+    memset(obj, 0, sizeof(FSNode *) * MAX_CHILDREN);
+}
+
+static bool fs_init_caches()
+{
+    if (!node_cache)
+        node_cache = kmem_cache_create("fsnode", sizeof(FSNode), KMEM_CACHE_ALIGN, node_ctor);
+    if (!children_cache)
+        children_cache = kmem_cache_create("fschildren", sizeof(FSNode *) * MAX_CHILDREN,
+                                           KMEM_CACHE_ALIGN, children_ctor);
+    return node_cache && children_cache;
+}
+
 FSNode *fs_create_node(const char *name, FSNodeType type)
 {
-    FSNode *node = (FSNode *)kmalloc(sizeof(FSNode));
+    if (!fs_init_caches())
+        return NULL;
+    FSNode *node = (FSNode *)kmem_cache_alloc(node_cache);
     if (!node)
         return NULL;
-    memset(node, 0, sizeof(FSNode));
     // Copy the name (ensure null termination)
     for (size_t i = 0; i < sizeof(node->name) - 1 && name[i]; i++)
     {
@@ -28,22 +55,45 @@ FSNode *fs_create_node(const char *name, FSNodeType type)
     if (type == FS_DIRECTORY)
     {
         // Allocate space for children pointers.
-        node->children = (FSNode **)kmalloc(sizeof(FSNode *) * MAX_CHILDREN);
-        if (node->children)
+        node->children = (FSNode **)kmem_cache_alloc(children_cache);
+        if (!node->children)
         {
-            memset(node->children, 0, sizeof(FSNode *) * MAX_CHILDREN);
+            kmem_cache_free(node_cache, node);
+            return NULL;
         }
     }
     return node;
 }
 
+void fs_destroy_node(FSNode *node)
+{
+    if (!node)
+        return;
+    if (node->type == FS_DIRECTORY)
+    {
+        for (size_t i = 0; i < node->child_count; i++)
+        {
+            fs_destroy_node(node->children[i]);
+        }
+        kmem_cache_free(children_cache, node->children);
+    }
+    // Drop descriptors that still refer to the node.
+    for (int fd = 0; fd < MAX_OPEN_FILES; fd++)
+    {
+        if (fd_table[fd].used && fd_table[fd].node == node)
+            fd_table[fd].used = 0;
+    }
+    kfree(node->data);
+    kmem_cache_free(node_cache, node);
+}
+
 void fs_add_child(FSNode *parent, FSNode *child)
 {
     if (!parent || parent->type != FS_DIRECTORY)
         return;
     if (parent->child_count >= MAX_CHILDREN)
     {
-        printf("Error: directory '%s' is full.\n", parent->name);
+        KTRACE(RAMFS, ERROR, "Error: directory '%s' is full.\n", parent->name);
         return;
     }
     parent->children[parent->child_count++] = child;
@@ -58,20 +108,14 @@ void fs_remove_child(FSNode *parent, FSNode *child)
     {
         if (parent->children[i] == child)
         {
-            // If the child has children, recursively remove them.
-            if (child->type == FS_DIRECTORY)
-            {
-                for (size_t j = 0; j < child->child_count; j++)
-                {
-                    fs_remove_child(child, child->children[j]);
-                }
-            }
             // Shift remaining children to the left.
             for (size_t j = i; j < parent->child_count - 1; j++)
             {
                 parent->children[j] = parent->children[j + 1];
             }
             parent->child_count--;
+            // Release the child and, for directories, everything below it.
+            fs_destroy_node(child);
             return;
         }
     }
@@ -97,11 +141,11 @@ void fs_init()
     root = fs_create_node("/", FS_DIRECTORY);
     if (root == NULL)
     {
-        printf("Error initializing filesystem: could not allocate root directory.\n");
+        KTRACE(RAMFS, ERROR, "Error initializing filesystem: could not allocate root directory.\n");
     }
     else
     {
-        printf("[RAMFS] Filesystem initialized.\n");
+        KTRACE(RAMFS, INFO, "[RAMFS] Filesystem initialized.\n");
     }
 }
 
@@ -142,7 +186,7 @@ int fs_write(FSNode *file, size_t offset, size_t size, const uint8_t *buffer)
         uint8_t *new_data = (uint8_t *)krealloc(file->data, offset + size);
         if (!new_data)
         {
-            printf("Write error: Out of memory for '%s'\n", file->name);
+            KTRACE(RAMFS, ERROR, "Write error: Out of memory for '%s'\n", file->name);
             return -1;
         }
         file->data = new_data;
@@ -7,7 +7,16 @@
 #include <kernel/timer.h>
 #include <kernel/ramfs.h>
 #include <kernel/heap.h>
+#include <kernel/memory.h>
+#include <kernel/kmem_cache.h>
+#include <kernel/vma.h>
+#include <kernel/workqueue.h>
+#include <kernel/irqstat.h>
 #include <kernel/shell.h>
+#include <kernel/tests/pmmbench.h>
+#include <kernel/tests/tlbbench.h>
+#include <kernel/tests/cowbench.h>
+#include <kernel/tests/irqbench.h>
 
 #define SHELL_BUFFER_SIZE 256
 #define NUM_COMMANDS 256
@@ -138,6 +147,146 @@ void cmd_rmdir(const char* args) {
     }
 }
 
+void cmd_heapstat(const char* args) {
+    (void)args;
+    static uint32_t last_ticks = 0;
+    static uint32_t last_allocs = 0;
+
+    heap_stats_t st;
+    heap_get_stats(&st);
+
+    // Allocation rate since the previous heapstat (or since boot).
+    uint32_t now = get_ticks();
+    uint32_t elapsed = now - last_ticks;
+    uint32_t rate = elapsed ? (st.alloc_count - last_allocs) * 1000 / elapsed : 0;
+    last_ticks = now;
+    last_allocs = st.alloc_count;
+
+    printf("Heap: %u KiB mapped, %u KiB in use (peak %u KiB)\n",
+           st.heap_size / 1024, st.bytes_in_use / 1024, st.peak_in_use / 1024);
+    printf("Free: %u KiB in %u blocks, largest %u KiB, fragmentation %u%%\n",
+           st.free_bytes / 1024, st.free_blocks, st.largest_free / 1024, st.fragmentation_pct);
+    printf("Blocks: %u used, %u slab pages, %u whole pages\n",
+           st.used_blocks, st.slab_pages, st.area_pages);
+    printf("Allocs: %u (%u/s), frees: %u, failed: %u\n",
+           st.alloc_count, rate, st.free_count, st.failed_allocs);
+    for (kmem_cache_t* cache = kmem_cache_list(); cache; cache = cache->next) {
+        printf("Cache %s: %u objects of %u bytes, %u slabs\n",
+               cache->name, cache->objs_in_use, cache->obj_size, cache->slab_count);
+    }
+
+    printf("Sizes:");
+    for (int i = 0; i < HEAP_HIST_BUCKETS; i++) {
+        if (st.size_histogram[i] == 0) {
+            continue;
+        }
+        if (i == HEAP_HIST_BUCKETS - 1) {
+            printf(" >%u:%u", 16u << (i - 1), st.size_histogram[i]);
+        } else {
+            printf(" <=%u:%u", 16u << i, st.size_histogram[i]);
+        }
+    }
+    printf("\n");
+}
+
+void cmd_meminfo(const char* args) {
+    (void)args;
+    uint32_t total = PhysicalMemoryManager::get_total_frames();
+    uint32_t free = PhysicalMemoryManager::get_free_frames();
+    printf("Frames: %u free of %u (%u KiB free)\n", free, total, free * (PAGE_SIZE / 1024));
+    for (int zone = 0; zone < ZONE_COUNT; zone++) {
+        pmm_zone_stats_t zs;
+        PhysicalMemoryManager::get_zone_stats((pmm_zone)zone, &zs);
+        if (zs.managed_frames == 0) {
+            continue;
+        }
+        printf("Zone %s: %u free of %u frames, %u fallback allocations\n",
+               PhysicalMemoryManager::zone_name((pmm_zone)zone), zs.free_frames,
+               zs.managed_frames, zs.fallback_allocs);
+    }
+    printf("Zero pool: %u/%u ready, %u hits, %u misses\n",
+           PhysicalMemoryManager::zero_pool_level(), PMM_ZERO_POOL_SIZE,
+           PhysicalMemoryManager::zero_pool_hits, PhysicalMemoryManager::zero_pool_misses);
+
+    const vma_t* areas;
+    uint32_t count = vma_list(&areas);
+    for (uint32_t i = 0; i < count; i++) {
+        printf("Area 0x%x-0x%x: %u pages populated on demand\n",
+               areas[i].start, areas[i].end, areas[i].faults);
+    }
+}
+
+void cmd_workq(const char* args) {
+    (void)args;
+    for (workqueue_t* wq = workqueue_list(); wq; wq = wq->next) {
+        printf("Queue %s: %u queued, %u run, %u dropped, max depth %u\n",
+               wq->name, wq->queued, wq->run, wq->dropped, wq->max_depth);
+        printf("  latency avg %u max %u cycles, longest work %u cycles\n",
+               wq->latency_avg, wq->latency_max, wq->work_max);
+    }
+}
+
+void cmd_irqstat(const char* args) {
+    if (!IRQ_STATS) {
+        printf("irqstat: built with IRQ_STATS=0\n");
+        return;
+    }
+    if (args && strcmp(args, "reset") == 0) {
+        irqstat_reset();
+        return;
+    }
+
+    // Share of all handler time per vector; scale the 64-bit totals into 32 bits first.
+    // The snapshot is static: it is too big for the 16 KiB kernel stack.
+    static irqstat_t stats[IRQSTAT_VECTORS];
+    uint64_t all = 0;
+    for (uint32_t v = 0; v < IRQSTAT_VECTORS; v++) {
+        irqstat_snapshot(v, &stats[v]);
+        all += stats[v].cycles_total;
+    }
+    uint32_t shift = 0;
+    while ((all >> shift) >= (1u << 24)) {
+        shift++;
+    }
+    uint32_t all_scaled = (uint32_t)(all >> shift);
+
+    for (uint32_t v = 0; v < IRQSTAT_VECTORS; v++) {
+        const irqstat_t* s = &stats[v];
+        if (s->count == 0) {
+            continue;
+        }
+        uint32_t share = all_scaled ? (uint32_t)(s->cycles_total >> shift) * 100 / all_scaled : 0;
+        if (v < 32) {
+            printf("Exception %u: ", v);
+        } else {
+            printf("IRQ %u: ", v - 32);
+        }
+        printf("%u calls, avg %u max %u cycles, %u%% of handler time\n",
+               s->count, irqstat_average(s), s->cycles_max, share);
+        printf("  log2(cycles):");
+        for (uint32_t b = 0; b < IRQSTAT_BUCKETS; b++) {
+            if (s->hist[b]) {
+                printf(" %u:%u", b, s->hist[b]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+void cmd_bench(const char* args) {
+    if (args && strcmp(args, "pmm") == 0) {
+        pmm_benchmark(16384);
+    } else if (args && strcmp(args, "tlb") == 0) {
+        tlb_benchmark();
+    } else if (args && strcmp(args, "cow") == 0) {
+        cow_benchmark();
+    } else if (args && strcmp(args, "irq") == 0) {
+        irq_benchmark();
+    } else {
+        printf("Usage: bench <pmm|tlb|cow|irq>\n");
+    }
+}
+
 shell_command_t commands[NUM_COMMANDS] = {
     {"help", cmd_help, "Show available commands"},
     {"ls", cmd_ls, "List directory contents"},
@@ -148,6 +297,11 @@ shell_command_t commands[NUM_COMMANDS] = {
     {"rm", cmd_rm, "Remove a file"},
     {"rmdir", cmd_rmdir, "Remove a directory"},
     {"uptime", cmd_uptime, "Show system uptime"},
+    {"heapstat", cmd_heapstat, "Show heap usage and fragmentation"},
+    {"meminfo", cmd_meminfo, "Show physical memory and zone usage"},
+    {"bench", cmd_bench, "Run a microbenchmark"},
+    {"workq", cmd_workq, "Show deferred work queue statistics"},
+    {"irqstat", cmd_irqstat, "Show per-vector interrupt counts and handler times"},
 };
 
 void cmd_help(const char* args) {
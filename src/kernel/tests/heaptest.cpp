@@ -5,15 +5,37 @@
 void heap_test() {
     printf("\n[TEST] Running Heap (kmalloc/kfree) Test...\n");
 
-    // Allocate three blocks
-    void* ptr1 = kmalloc(64);
-    printf("[TEST] Allocated 64 bytes at %p\n", ptr1);
+    // Small objects come from the slab classes: a freed object is handed out again first.
+    void* small1 = kmalloc(40);
+    kfree(small1);
+    void* small2 = kmalloc(48);
+    if (small1 && small1 == small2) {
+        printf("[PASS] Slab object was recycled from its size class.\n");
+    } else {
+        printf("[FAIL] Slab object was not recycled!\n");
+    }
+    kfree(small2);
+
+    // Aligned requests honour the alignment; large ones are handed out as whole pages.
+    void* aligned = kmalloc_aligned(100, 256);
+    void* pages = kmalloc_pages(4);
+    if (aligned && ((uintptr_t)aligned & 255) == 0 && pages && ((uintptr_t)pages & 4095) == 0) {
+        printf("[PASS] Aligned and page allocations are correctly aligned.\n");
+    } else {
+        printf("[FAIL] Aligned or page allocation is misaligned!\n");
+    }
+    kfree(aligned);
+    kfree(pages);
+
+    // Allocate three blocks (above the slab limit, so they use the block allocator)
+    void* ptr1 = kmalloc(2048);
+    printf("[TEST] Allocated 2048 bytes at %p\n", ptr1);
 
-    void* ptr2 = kmalloc(128);
-    printf("[TEST] Allocated 128 bytes at %p\n", ptr2);
+    void* ptr2 = kmalloc(4096);
+    printf("[TEST] Allocated 4096 bytes at %p\n", ptr2);
 
-    void* ptr3 = kmalloc(32);
-    printf("[TEST] Allocated 32 bytes at %p\n", ptr3);
+    void* ptr3 = kmalloc(1536);
+    printf("[TEST] Allocated 1536 bytes at %p\n", ptr3);
 
     // Check for overlapping allocations
     if (ptr1 && ptr2 && ptr3) {
@@ -30,8 +52,8 @@ void heap_test() {
     kfree(ptr2);
     printf("[TEST] Freed second allocation at %p\n", ptr2);
 
-    void* ptr4 = kmalloc(64);
-    printf("[TEST] Allocated 64 bytes at %p\n", ptr4);
+    void* ptr4 = kmalloc(2048);
+    printf("[TEST] Allocated 2048 bytes at %p\n", ptr4);
 
     // Check if freed memory is reused
     if (ptr4 == ptr2) {
@@ -47,8 +69,8 @@ void heap_test() {
     printf("[TEST] Freed all allocations.\n");
 
     // Check merging
-    void* ptr5 = kmalloc(128);
-    printf("[TEST] Allocated 128 bytes at %p\n", ptr5);
+    void* ptr5 = kmalloc(4096);
+    printf("[TEST] Allocated 4096 bytes at %p\n", ptr5);
 
     if (ptr5 == ptr1) {
         printf("[PASS] Free block merging works correctly.\n");
@@ -0,0 +1,50 @@
+# Entry points for irq_benchmark. irqbench_fast enters through the real irq_common_stub;
+# irqbench_legacy through a copy of the entry path as it was before the ring-0 fast path:
+# cli in the stub, unconditional segment reloads, and sti before iret.
+
+.set IRQBENCH_FAST_VECTOR, 0xF0     # Must match irqbench.cpp
+.set IRQBENCH_LEGACY_VECTOR, 0xF1
+
+.section .text
+.extern irq_common_stub
+.extern irqbench_legacy_handler
+
+.global irqbench_fast
+irqbench_fast:
+    pushl $0                # Push dummy error code
+    pushl $IRQBENCH_FAST_VECTOR
+    jmp irq_common_stub
+
+.global irqbench_legacy
+irqbench_legacy:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $IRQBENCH_LEGACY_VECTOR
+    jmp legacy_common_stub
+
+legacy_common_stub:
+    cli
+    pusha
+    movw %ds, %ax
+    pushl %eax
+
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+
+    pushl %esp
+    call irqbench_legacy_handler
+    addl $4, %esp
+
+    popl %eax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+
+    popa
+    addl $8, %esp
+    sti
+    iret
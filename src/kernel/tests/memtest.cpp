@@ -2,7 +2,7 @@
 #include <kernel/memory.h>
 
 bool MemoryTester::test_allocation() {
-    void* frame = PhysicalMemoryManager::allocate_frame();
+    void* frame = PhysicalMemoryManager::allocate_frame(ZONE_DMA);
     if (!frame) return false;
     
     // Test if we can write to and read from the allocated memory
@@ -15,13 +15,13 @@ bool MemoryTester::test_allocation() {
 }
 
 bool MemoryTester::test_free() {
-    void* frame1 = PhysicalMemoryManager::allocate_frame();
+    void* frame1 = PhysicalMemoryManager::allocate_frame(ZONE_DMA);
     if (!frame1) return false;
     
     PhysicalMemoryManager::free_frame(frame1);
     
     // Try to allocate again - should get the same frame
-    void* frame2 = PhysicalMemoryManager::allocate_frame();
+    void* frame2 = PhysicalMemoryManager::allocate_frame(ZONE_DMA);
     bool success = (frame1 == frame2);
     
     PhysicalMemoryManager::free_frame(frame2);
@@ -34,7 +34,7 @@ bool MemoryTester::test_multiple_allocations() {
     
     // Allocate multiple frames
     for (int i = 0; i < NUM_ALLOCATIONS; i++) {
-        frames[i] = PhysicalMemoryManager::allocate_frame();
+        frames[i] = PhysicalMemoryManager::allocate_frame(ZONE_DMA);
         if (!frames[i]) return false;
         
         // Write unique pattern to each frame
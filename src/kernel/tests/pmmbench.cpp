@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <kernel/cpu.h>
+#include <kernel/heap.h>
+#include <kernel/memory.h>
+#include <kernel/tests/pmmbench.h>
+
+#define PMM_BENCH_SHIFT      10    // 1024 searches per variant
+#define PMM_BENCH_ITERATIONS (1 << PMM_BENCH_SHIFT)
+
+static uint32_t cycles_per_call(uint64_t start, uint64_t end) {
+    // Divide the full 64-bit count before narrowing; a shift needs no libgcc divide.
+    return (uint32_t)((end - start) >> PMM_BENCH_SHIFT);
+}
+
+void pmm_benchmark(uint32_t frames) {
+    // Fill low memory, where both searches start, and leave some DMA frames for the
+    // rest of the kernel. allocate_frame() alone would come from ZONE_NORMAL on most
+    // machines and leave low memory as empty as it was.
+    pmm_zone_stats_t dma;
+    PhysicalMemoryManager::get_zone_stats(ZONE_DMA, &dma);
+    uint32_t available = dma.free_frames;
+    if (frames + 256 > available) {
+        frames = available > 256 ? available - 256 : 0;
+    }
+
+    void** allocated = (void**)kmalloc(frames * sizeof(void*));
+    if (!allocated) {
+        printf("[BENCH] Out of memory\n");
+        return;
+    }
+    uint32_t taken = 0;
+    while (taken < frames && (allocated[taken] = PhysicalMemoryManager::allocate_frame(ZONE_DMA))) {
+        taken++;
+    }
+
+    uint32_t expected = PhysicalMemoryManager::first_free_linear();
+    uint64_t start = rdtsc();
+    for (int i = 0; i < PMM_BENCH_ITERATIONS; i++) {
+        PhysicalMemoryManager::first_free_linear();
+    }
+    uint64_t mid = rdtsc();
+    uint32_t found = 0;
+    for (int i = 0; i < PMM_BENCH_ITERATIONS; i++) {
+        found = PhysicalMemoryManager::first_free();
+    }
+    uint64_t end = rdtsc();
+
+    printf("[BENCH] PMM search with %u frames used: linear %u cycles, summary %u cycles%s\n",
+           PhysicalMemoryManager::used_frames, cycles_per_call(start, mid), cycles_per_call(mid, end),
+           found == expected ? "" : " (MISMATCH)");
+
+    for (uint32_t i = 0; i < taken; i++) {
+        PhysicalMemoryManager::free_frame(allocated[i]);
+    }
+    kfree(allocated);
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <kernel/cpu.h>
+#include <kernel/paging.h>
+#include <kernel/tests/tlbbench.h>
+
+#define TLB_BENCH_ALIAS     0xC0000000  // Scratch window for the 4 KiB-page alias
+#define TLB_BENCH_ACCESSES  200000
+
+// Read one word from a pseudo-random page of [base, base + VMM_IDENTITY_LIMIT) per access.
+// The page count far exceeds the TLB when 4 KiB pages are used, so most accesses miss.
+static uint32_t walk(uint32_t base) {
+    uint32_t seed = 12345;
+    uint32_t sum = 0;
+    for (int i = 0; i < TLB_BENCH_ACCESSES; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t page = (seed >> 8) % (VMM_IDENTITY_LIMIT / PAGE_SIZE - 1) + 1;  // Skip page 0
+        sum += *(volatile uint32_t*)(base + page * PAGE_SIZE);
+    }
+    return sum;
+}
+
+static uint32_t cycles_per_access(uint32_t base) {
+    walk(base);  // Warm up caches and page tables
+    uint64_t start = rdtsc();
+    walk(base);
+    uint64_t end = rdtsc();
+    return (uint32_t)(end - start) / TLB_BENCH_ACCESSES;
+}
+
+void tlb_benchmark() {
+    uint64_t start = rdtsc();
+    if (!vmm_map_range(TLB_BENCH_ALIAS, 0, VMM_IDENTITY_LIMIT, 0)) {
+        printf("[BENCH] Out of memory for the alias mapping\n");
+        return;
+    }
+    uint32_t map_cycles = (uint32_t)(rdtsc() - start);
+
+    uint32_t identity = cycles_per_access(0);
+    uint32_t alias = cycles_per_access(TLB_BENCH_ALIAS);
+    printf("[BENCH] Random page reads over 16 MiB: %u cycles via %u KiB pages, %u cycles via 4 KiB pages\n",
+           identity, vmm_large_pages_enabled() ? LARGE_PAGE_SIZE / 1024 : 4, alias);
+
+    start = rdtsc();
+    vmm_unmap_range(TLB_BENCH_ALIAS, VMM_IDENTITY_LIMIT, 0);
+    uint32_t unmap_cycles = (uint32_t)(rdtsc() - start);
+    printf("[BENCH] Range map of 16 MiB: %u cycles, unmap: %u cycles\n", map_cycles, unmap_cycles);
+}
@@ -22,6 +22,7 @@ void init_timer(uint32_t frequency) {
 
     // Register timer_handler for IRQ0 (interrupt 32).
     register_interrupt_handler(32, timer_handler);
+    irq_unmask(0);
 
     printf("[TIMER] Timer initialized to %d Hz\n", frequency);
 }
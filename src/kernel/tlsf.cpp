@@ -0,0 +1,393 @@
+#include <kernel/tlsf.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Second-level subdivisions per first-level class (2^4 = 16).
+#define SL_INDEX_COUNT_LOG2  4
+#define SL_INDEX_COUNT       (1 << SL_INDEX_COUNT_LOG2)
+
+// All block sizes are multiples of 16 bytes.
+#define ALIGN_SIZE_LOG2      4
+#define ALIGN_SIZE           (1 << ALIGN_SIZE_LOG2)
+
+// Blocks below SMALL_BLOCK_SIZE share first-level class 0, split linearly.
+#define FL_INDEX_SHIFT       (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_MAX         30
+#define FL_INDEX_COUNT       (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE     (1 << FL_INDEX_SHIFT)
+
+#define BLOCK_FREE           0x1
+#define BLOCK_SIZE_MASK      (~(size_t)(ALIGN_SIZE - 1))
+
+// Block header. prev_phys is the boundary tag used to find the physically previous
+// block; next_free/prev_free are only meaningful while the block sits in a free list.
+typedef struct tlsf_block {
+    struct tlsf_block* prev_phys;
+    size_t size;                     // Payload size, low bits hold BLOCK_FREE
+    struct tlsf_block* next_free;
+    struct tlsf_block* prev_free;
+} __attribute__((aligned(16))) tlsf_block_t;
+
+#define BLOCK_HEADER_SIZE    sizeof(tlsf_block_t)
+#define BLOCK_SIZE_MIN       ALIGN_SIZE
+
+typedef struct tlsf_control {
+    tlsf_block_t* first;             // Physically first block of the pool
+    tlsf_block_t* sentinel;          // Zero-sized used block marking the end of the pool
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
+    tlsf_block_t* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+} tlsf_control_t;
+
+static tlsf_control_t control;
+
+static inline int tlsf_fls(uint32_t word) {
+    return word ? 31 - __builtin_clz(word) : -1;
+}
+
+static inline int tlsf_ffs(uint32_t word) {
+    return word ? __builtin_ctz(word) : -1;
+}
+
+static inline size_t block_size(const tlsf_block_t* block) {
+    return block->size & BLOCK_SIZE_MASK;
+}
+
+static inline int block_is_free(const tlsf_block_t* block) {
+    return (block->size & BLOCK_FREE) != 0;
+}
+
+static inline void block_set_size(tlsf_block_t* block, size_t size) {
+    block->size = size | (block->size & BLOCK_FREE);
+}
+
+static inline void* block_to_ptr(tlsf_block_t* block) {
+    return (uint8_t*)block + BLOCK_HEADER_SIZE;
+}
+
+static inline tlsf_block_t* block_from_ptr(void* ptr) {
+    return (tlsf_block_t*)((uint8_t*)ptr - BLOCK_HEADER_SIZE);
+}
+
+static inline tlsf_block_t* block_next(tlsf_block_t* block) {
+    return (tlsf_block_t*)((uint8_t*)block + BLOCK_HEADER_SIZE + block_size(block));
+}
+
+static inline size_t align_up(size_t x, size_t align) {
+    return (x + (align - 1)) & ~(align - 1);
+}
+
+// Size -> (first level, second level) list indices.
+static void mapping_insert(size_t size, int* fli, int* sli) {
+    int fl, sl;
+    if (size < SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = (int)size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    } else {
+        fl = tlsf_fls(size);
+        sl = (int)(size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        fl -= (FL_INDEX_SHIFT - 1);
+    }
+    *fli = fl;
+    *sli = sl;
+}
+
+// Like mapping_insert, but rounds up so any block in the resulting list fits 'size'.
+static void mapping_search(size_t size, int* fli, int* sli) {
+    if (size >= SMALL_BLOCK_SIZE) {
+        size_t round = (1 << (tlsf_fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+        size += round;
+    }
+    mapping_insert(size, fli, sli);
+}
+
+static tlsf_block_t* search_suitable_block(int* fli, int* sli) {
+    int fl = *fli;
+    int sl = *sli;
+
+    if (fl >= FL_INDEX_COUNT) {
+        return NULL;
+    }
+
+    uint32_t sl_map = control.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = (fl + 1 < 32) ? control.fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = tlsf_ffs(fl_map);
+        sl_map = control.sl_bitmap[fl];
+    }
+    sl = tlsf_ffs(sl_map);
+
+    *fli = fl;
+    *sli = sl;
+    return control.blocks[fl][sl];
+}
+
+static void remove_free_block(tlsf_block_t* block, int fl, int sl) {
+    tlsf_block_t* prev = block->prev_free;
+    tlsf_block_t* next = block->next_free;
+    if (next) {
+        next->prev_free = prev;
+    }
+    if (prev) {
+        prev->next_free = next;
+    }
+
+    if (control.blocks[fl][sl] == block) {
+        control.blocks[fl][sl] = next;
+        if (!next) {
+            control.sl_bitmap[fl] &= ~(1u << sl);
+            if (!control.sl_bitmap[fl]) {
+                control.fl_bitmap &= ~(1u << fl);
+            }
+        }
+    }
+}
+
+static void insert_free_block(tlsf_block_t* block, int fl, int sl) {
+    tlsf_block_t* current = control.blocks[fl][sl];
+    block->next_free = current;
+    block->prev_free = NULL;
+    if (current) {
+        current->prev_free = block;
+    }
+    control.blocks[fl][sl] = block;
+    control.fl_bitmap |= (1u << fl);
+    control.sl_bitmap[fl] |= (1u << sl);
+}
+
+static void block_remove(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    remove_free_block(block, fl, sl);
+}
+
+static void block_insert(tlsf_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    insert_free_block(block, fl, sl);
+}
+
+static void block_mark_free(tlsf_block_t* block) {
+    block->size |= BLOCK_FREE;
+}
+
+static void block_mark_used(tlsf_block_t* block) {
+    block->size &= ~(size_t)BLOCK_FREE;
+}
+
+// Split 'block' so it keeps 'size' bytes; the tail becomes a new free block.
+// Returns the tail, or NULL if the remainder is too small to stand alone.
+static tlsf_block_t* block_split(tlsf_block_t* block, size_t size) {
+    if (block_size(block) < size + BLOCK_HEADER_SIZE + BLOCK_SIZE_MIN) {
+        return NULL;
+    }
+
+    tlsf_block_t* remaining = (tlsf_block_t*)((uint8_t*)block_to_ptr(block) + size);
+    remaining->size = block_size(block) - size - BLOCK_HEADER_SIZE;
+    remaining->prev_phys = block;
+    block_mark_free(remaining);
+    block_next(remaining)->prev_phys = remaining;
+    block_set_size(block, size);
+    return remaining;
+}
+
+// Absorb the (free, already unlinked) physically next block into 'block'.
+static void block_absorb(tlsf_block_t* block, tlsf_block_t* next) {
+    block_set_size(block, block_size(block) + BLOCK_HEADER_SIZE + block_size(next));
+    block_next(block)->prev_phys = block;
+}
+
+static tlsf_block_t* block_merge_prev(tlsf_block_t* block) {
+    tlsf_block_t* prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        block_remove(prev);
+        block_absorb(prev, block);
+        block = prev;
+    }
+    return block;
+}
+
+static tlsf_block_t* block_merge_next(tlsf_block_t* block) {
+    tlsf_block_t* next = block_next(block);
+    if (block_is_free(next)) {
+        block_remove(next);
+        block_absorb(block, next);
+    }
+    return block;
+}
+
+static size_t adjust_request_size(size_t size) {
+    size = align_up(size, ALIGN_SIZE);
+    return size < BLOCK_SIZE_MIN ? BLOCK_SIZE_MIN : size;
+}
+
+// Take the block out of the free lists, trim it to 'size' and mark it used.
+static void* block_prepare_used(tlsf_block_t* block, size_t size) {
+    tlsf_block_t* remaining = block_split(block, size);
+    if (remaining) {
+        block_insert(remaining);
+    }
+    block_mark_used(block);
+    return block_to_ptr(block);
+}
+
+void tlsf_init(void* pool, size_t size) {
+    memset(&control, 0, sizeof(control));
+
+    uintptr_t start = align_up((uintptr_t)pool, ALIGN_SIZE);
+    size_t usable = (size - (start - (uintptr_t)pool)) & BLOCK_SIZE_MASK;
+
+    // One free block spanning the pool, followed by a zero-sized used sentinel
+    // so block_next() never runs off the end.
+    tlsf_block_t* block = (tlsf_block_t*)start;
+    block->prev_phys = NULL;
+    block->size = usable - 2 * BLOCK_HEADER_SIZE;
+    block_mark_free(block);
+
+    tlsf_block_t* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+    control.sentinel = sentinel;
+    control.first = block;
+
+    block_insert(block);
+}
+
+void tlsf_grow(size_t size) {
+    // The old sentinel header becomes the header of the new free block.
+    tlsf_block_t* block = control.sentinel;
+    block->size = (size & BLOCK_SIZE_MASK) - BLOCK_HEADER_SIZE;
+    block_mark_free(block);
+
+    tlsf_block_t* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+    control.sentinel = sentinel;
+
+    block = block_merge_prev(block);
+    block_insert(block);
+}
+
+size_t tlsf_trailing_free() {
+    tlsf_block_t* last = control.sentinel->prev_phys;
+    return (last && block_is_free(last)) ? block_size(last) : 0;
+}
+
+void tlsf_shrink(size_t size) {
+    tlsf_block_t* last = control.sentinel->prev_phys;
+    block_remove(last);
+    block_set_size(last, block_size(last) - size);
+
+    tlsf_block_t* sentinel = block_next(last);
+    sentinel->prev_phys = last;
+    sentinel->size = 0;
+    control.sentinel = sentinel;
+
+    block_insert(last);
+}
+
+void* tlsf_malloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    size = adjust_request_size(size);
+
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    tlsf_block_t* block = search_suitable_block(&fl, &sl);
+    if (!block) {
+        return NULL;
+    }
+    remove_free_block(block, fl, sl);
+    return block_prepare_used(block, size);
+}
+
+void* tlsf_memalign(size_t align, size_t size) {
+    if (align <= ALIGN_SIZE) {
+        return tlsf_malloc(size);
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    size = adjust_request_size(size);
+
+    // Room for the worst-case gap plus a minimum free block to hold it.
+    size_t gap_min = BLOCK_HEADER_SIZE + BLOCK_SIZE_MIN;
+    int fl, sl;
+    mapping_search(size + align + gap_min, &fl, &sl);
+    tlsf_block_t* block = search_suitable_block(&fl, &sl);
+    if (!block) {
+        return NULL;
+    }
+    remove_free_block(block, fl, sl);
+
+    uintptr_t payload = (uintptr_t)block_to_ptr(block);
+    uintptr_t aligned = align_up(payload, align);
+    while (aligned != payload && aligned - payload < gap_min) {
+        aligned += align;
+    }
+
+    // Give the leading gap back as its own free block. Its physical predecessor is
+    // in use (free blocks are always coalesced), so no merge is needed.
+    if (aligned != payload) {
+        tlsf_block_t* aligned_block = block_from_ptr((void*)aligned);
+        aligned_block->size = block_size(block) - (aligned - payload);
+        aligned_block->prev_phys = block;
+        block_next(aligned_block)->prev_phys = aligned_block;
+        block_set_size(block, aligned - payload - BLOCK_HEADER_SIZE);
+        block_insert(block);
+        block = aligned_block;
+    }
+
+    return block_prepare_used(block, size);
+}
+
+void tlsf_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    tlsf_block_t* block = block_from_ptr(ptr);
+    block_mark_free(block);
+    block = block_merge_prev(block);
+    block = block_merge_next(block);
+    block_insert(block);
+}
+
+int tlsf_resize(void* ptr, size_t size) {
+    if (!ptr || size == 0) {
+        return 0;
+    }
+    tlsf_block_t* block = block_from_ptr(ptr);
+    size = adjust_request_size(size);
+
+    if (size > block_size(block)) {
+        tlsf_block_t* next = block_next(block);
+        if (!block_is_free(next) ||
+            block_size(block) + BLOCK_HEADER_SIZE + block_size(next) < size) {
+            return 0;
+        }
+        block_remove(next);
+        block_absorb(block, next);
+    }
+
+    tlsf_block_t* remaining = block_split(block, size);
+    if (remaining) {
+        remaining = block_merge_next(remaining);
+        block_insert(remaining);
+    }
+    return 1;
+}
+
+void tlsf_walk(tlsf_walker_t walker, void* user) {
+    for (tlsf_block_t* block = control.first; block != control.sentinel; block = block_next(block)) {
+        walker(block_to_ptr(block), block_size(block), !block_is_free(block), user);
+    }
+}
+
+size_t tlsf_block_size(void* ptr) {
+    return ptr ? block_size(block_from_ptr(ptr)) : 0;
+}
@@ -0,0 +1,112 @@
+#include <kernel/vma.h>
+#include <kernel/memory.h>
+#include <kernel/paging.h>
+#include <kernel/trace.h>
+#include <string.h>
+
+// Sorted by start address, so a fault finds its area with a binary search.
+static vma_t areas[VMA_MAX];
+static uint32_t area_count = 0;
+
+int vma_register(uint32_t start, uint32_t size, uint32_t flags, vma_check_t check)
+{
+    uint32_t end = start + size;
+    if (area_count == VMA_MAX || size == 0 || end < start ||
+        (start | size) & (PAGE_SIZE - 1)) {
+        return 0;
+    }
+
+    uint32_t pos = 0;
+    while (pos < area_count && areas[pos].start < start) {
+        pos++;
+    }
+    if ((pos > 0 && areas[pos - 1].end > start) || (pos < area_count && areas[pos].start < end)) {
+        KTRACE(VMM, ERROR, "[VMA] 0x%x..0x%x overlaps an existing area\n", start, end);
+        return 0;
+    }
+
+    memmove(&areas[pos + 1], &areas[pos], (area_count - pos) * sizeof(vma_t));
+    areas[pos].start = start;
+    areas[pos].end = end;
+    areas[pos].flags = flags;
+    areas[pos].check = check;
+    areas[pos].faults = 0;
+    area_count++;
+    KTRACE(VMM, DEBUG, "[VMA] Registered 0x%x..0x%x\n", start, end);
+    return 1;
+}
+
+void vma_unregister(uint32_t start)
+{
+    for (uint32_t i = 0; i < area_count; i++) {
+        if (areas[i].start == start) {
+            memmove(&areas[i], &areas[i + 1], (area_count - i - 1) * sizeof(vma_t));
+            area_count--;
+            return;
+        }
+    }
+}
+
+static vma_t* find_area(uint32_t addr)
+{
+    uint32_t lo = 0, hi = area_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (addr < areas[mid].start) {
+            hi = mid;
+        } else if (addr >= areas[mid].end) {
+            lo = mid + 1;
+        } else {
+            return &areas[mid];
+        }
+    }
+    return NULL;
+}
+
+const vma_t* vma_find(uint32_t addr)
+{
+    return find_area(addr);
+}
+
+int vma_handle_fault(uint32_t addr, uint32_t err_code)
+{
+    // Only not-present faults; a protection fault on a populated page is a real bug.
+    if (err_code & 0x1) {
+        return 0;
+    }
+    vma_t* area = find_area(addr);
+    if (!area || (area->check && !area->check(addr))) {
+        return 0;
+    }
+    if ((err_code & 0x2) && !(area->flags & VMA_WRITE)) {
+        return 0;
+    }
+
+    // Take the frame from the highest zone, above 4 GiB with PAE, and clear it through its
+    // new mapping. The pre-zeroed pool is not used here: it is filled from ZONE_DMA for
+    // page tables, and bulk demand paging would drain that zone down to its reserve.
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    uint32_t pfn = PhysicalMemoryManager::allocate_pfn();
+    if (!pfn) {
+        KTRACE(VMM, ERROR, "[VMA] Out of memory populating 0x%x\n", page);
+        return 0;
+    }
+    if (!vmm_map_pfn(page, pfn, 1)) {
+        PhysicalMemoryManager::free_pfn(pfn);
+        return 0;
+    }
+    memset((void*)page, 0, PAGE_SIZE);
+    // The page is populated writable even for read-only areas so it can be cleared above;
+    // drop write access afterwards.
+    if (!(area->flags & VMA_WRITE)) {
+        vmm_protect(page, 0);
+    }
+    area->faults++;
+    return 1;
+}
+
+uint32_t vma_list(const vma_t** list)
+{
+    *list = areas;
+    return area_count;
+}
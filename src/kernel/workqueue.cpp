@@ -0,0 +1,136 @@
+#include <kernel/workqueue.h>
+#include <kernel/cpu.h>
+#include <string.h>
+
+// Slot protocol: slot i of a ring is free for the producer claiming position p when its
+// seq equals p, holds finished work for the consumer when seq equals p + 1, and becomes
+// free for position p + WORKQUEUE_SIZE once consumed. Positions only grow; the ring
+// index is the low bits.
+
+static workqueue_t* queue_list = NULL;
+
+static inline uint32_t clamp_cycles(uint64_t cycles)
+{
+    return cycles > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)cycles;
+}
+
+void workqueue_init(workqueue_t* wq, const char* name)
+{
+    memset(wq, 0, sizeof(workqueue_t));
+    wq->name = name;
+    for (uint32_t i = 0; i < WORKQUEUE_SIZE; i++) {
+        wq->items[i].seq = i;
+    }
+
+    uint32_t flags = irq_save();
+    wq->next = queue_list;
+    queue_list = wq;
+    irq_restore(flags);
+}
+
+bool work_queue(workqueue_t* wq, work_fn_t fn, const void* data, size_t len)
+{
+    if (len > WORK_DATA_SIZE) {
+        return false;
+    }
+
+    uint32_t pos = wq->tail;
+    work_item_t* item;
+    for (;;) {
+        item = &wq->items[pos & (WORKQUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(item->seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&wq->tail, &pos, pos + 1, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                break;
+            }
+            // 'pos' now holds the tail another producer moved on to; retry there.
+        } else if (diff < 0) {
+            __atomic_fetch_add(&wq->dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            pos = wq->tail;
+        }
+    }
+
+    item->fn = fn;
+    item->queued_at = rdtsc();
+    if (len) {
+        memcpy(item->data, data, len);
+    }
+    __atomic_store_n(&item->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&wq->queued, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Run the items of one queue that are ready, in order.
+static uint32_t workqueue_run(workqueue_t* wq)
+{
+    uint32_t done = 0;
+    for (;;) {
+        uint32_t pos = wq->head;
+        work_item_t* item = &wq->items[pos & (WORKQUEUE_SIZE - 1)];
+        if (__atomic_load_n(&item->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+
+        uint32_t depth = wq->tail - pos;
+        if (depth > wq->max_depth) {
+            wq->max_depth = depth;
+        }
+
+        // Copy the item out and free its slot before running it, so the work function
+        // may queue more work, even on this queue.
+        work_fn_t fn = item->fn;
+        uint64_t queued_at = item->queued_at;
+        uint8_t data[WORK_DATA_SIZE];
+        memcpy(data, item->data, WORK_DATA_SIZE);
+        wq->head = pos + 1;
+        __atomic_store_n(&item->seq, pos + WORKQUEUE_SIZE, __ATOMIC_RELEASE);
+
+        uint64_t start = rdtsc();
+        uint32_t latency = clamp_cycles(start - queued_at);
+        fn(data);
+        uint32_t work = clamp_cycles(rdtsc() - start);
+
+        if (wq->run == 0) {
+            wq->latency_avg = latency;
+        } else {
+            wq->latency_avg += ((int32_t)(latency - wq->latency_avg)) / 8;
+        }
+        if (latency > wq->latency_max) {
+            wq->latency_max = latency;
+        }
+        if (work > wq->work_max) {
+            wq->work_max = work;
+        }
+        wq->run++;
+        done++;
+    }
+    return done;
+}
+
+uint32_t workqueue_run_all()
+{
+    uint32_t done = 0;
+    for (workqueue_t* wq = queue_list; wq; wq = wq->next) {
+        done += workqueue_run(wq);
+    }
+    return done;
+}
+
+bool workqueue_pending()
+{
+    for (workqueue_t* wq = queue_list; wq; wq = wq->next) {
+        work_item_t* item = &wq->items[wq->head & (WORKQUEUE_SIZE - 1)];
+        if (__atomic_load_n(&item->seq, __ATOMIC_ACQUIRE) == wq->head + 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+workqueue_t* workqueue_list()
+{
+    return queue_list;
+}